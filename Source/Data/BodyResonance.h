@@ -0,0 +1,127 @@
+#pragma once
+
+// ====== COMMUTED INSTRUMENT BODY =======
+// The body is linear and time invariant, so instead of giving every voice its own resonator
+// it is applied once to the summed output - the cost stays fixed no matter how many notes ring.
+class BodyResonance
+{
+public:
+    // ====== SETUP - THE CONVOLUTION AND ITS LOADER THREAD ARE ONLY BUILT HERE, SO A PLUGIN SCAN NEVER PAYS FOR THEM =======
+    void prepare (const juce::dsp::ProcessSpec& spec)
+    {
+        if (convolution == nullptr)
+        {
+            loaderQueue = std::make_unique<juce::SharedResourcePointer<juce::dsp::ConvolutionMessageQueue>>();
+            convolution = std::make_unique<juce::dsp::Convolution> (juce::dsp::Convolution::NonUniform { 256 }, **loaderQueue); // Zero latency head, larger partitions for the tail
+        }
+
+        convolution->prepare (spec);
+        mixer.prepare (spec);
+        mixer.setMixingRule (juce::dsp::DryWetMixingRule::balanced);
+
+        if (pendingFile.existsAsFile()) // Restored with the state before the first prepare
+        {
+            const juce::File file (pendingFile);
+            pendingFile = juce::File();
+            loadImpulseResponse (file);
+        }
+        else if (! hasLoadedFile)
+        {
+            loadDefaultBody (spec.sampleRate);
+        }
+    }
+
+    void reset()
+    {
+        if (convolution != nullptr)
+            convolution->reset();
+
+        mixer.reset();
+    }
+
+    void setMix (float newMix) // Takes values between 0-1
+    {
+        mix = newMix;
+        mixer.setWetMixProportion (mix);
+    }
+
+    // ====== IMPULSE RESPONSE =======
+    void loadImpulseResponse (const juce::File& file) // Loading happens on a background thread inside juce::dsp::Convolution
+    {
+        if (! file.existsAsFile())
+            return;
+
+        if (convolution == nullptr)
+        {
+            pendingFile = file;
+            return;
+        }
+
+        convolution->loadImpulseResponse (file,
+                                         juce::dsp::Convolution::Stereo::yes,
+                                         juce::dsp::Convolution::Trim::yes,
+                                         0, // Use the whole file
+                                         juce::dsp::Convolution::Normalise::yes);
+        hasLoadedFile = true;
+    }
+
+    // Fallback body made of a handful of decaying wood-like modes, so the mode works without a file
+    void loadDefaultBody (double sampleRate)
+    {
+        const float modeFreqs[]  { 98.0f, 204.0f, 283.0f, 390.0f, 532.0f, 780.0f, 1150.0f, 2100.0f };
+        const float modeDecays[] { 0.25f, 0.18f,  0.15f,  0.12f,  0.09f,  0.07f,  0.05f,   0.03f  }; // Seconds to -60dB
+        const float modeGains[]  { 1.0f,  0.8f,   0.6f,   0.5f,   0.35f,  0.25f,  0.15f,   0.1f   };
+
+        const int length = (int) (sampleRate * 0.3);
+        juce::AudioBuffer<float> impulse (1, length);
+        auto* data = impulse.getWritePointer (0);
+
+        for (int i = 0; i < length; ++i)
+        {
+            const float t = (float) i / (float) sampleRate;
+            float sample = 0.0f;
+
+            for (int m = 0; m < 8; ++m)
+                sample += modeGains[m]
+                          * std::exp (-6.9f * t / modeDecays[m]) // ln(1000) gives the -60dB point
+                          * std::sin (juce::MathConstants<float>::twoPi * modeFreqs[m] * t);
+
+            data[i] = sample;
+        }
+
+        data[0] += 1.0f; // Keep the direct sound
+
+        convolution->loadImpulseResponse (std::move (impulse), sampleRate,
+                                         juce::dsp::Convolution::Stereo::no,
+                                         juce::dsp::Convolution::Trim::no,
+                                         juce::dsp::Convolution::Normalise::yes);
+    }
+
+    // ====== PROCESS =======
+    void process (juce::AudioBuffer<float>& buffer)
+    {
+        if ((mix <= 0.0f && ! isActive) || convolution == nullptr) // Bypassed - no convolution cost at all
+            return;
+
+        if (! isActive)
+            convolution->reset(); // Drop the stale tail from the last time the body was on
+
+        isActive = mix > 0.0f; // One more block after switching off lets the mixer fade out
+
+        juce::dsp::AudioBlock<float> block (buffer);
+        mixer.pushDrySamples (block);
+        convolution->process (juce::dsp::ProcessContextReplacing<float> (block));
+        mixer.mixWetSamples (block);
+    }
+
+private:
+    // One impulse response loader thread for every instance in the process, instead of one each
+    std::unique_ptr<juce::SharedResourcePointer<juce::dsp::ConvolutionMessageQueue>> loaderQueue;
+    std::unique_ptr<juce::dsp::Convolution> convolution;
+    juce::dsp::DryWetMixer<float> mixer;
+    juce::File pendingFile; // Loaded by the first prepare()
+
+    float mix = 0.0f;
+    bool isActive = false;
+    bool hasLoadedFile = false;
+};
@@ -0,0 +1,313 @@
+/*
+  ==============================================================================
+
+    DspKernels.cpp
+    Hot DSP loops compiled per instruction set, selected at load from CPUID.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "DspKernels.h"
+#include "StringModel.h"
+
+#if (defined (__GNUC__) || defined (__clang__)) && (defined (__x86_64__) || defined (__i386__))
+ #define KARPLUSPLUS_DISPATCH 1
+ #define KARPLUSPLUS_TARGET(isa) __attribute__ ((target (isa)))
+ #define KARPLUSPLUS_INLINE inline __attribute__ ((always_inline))
+ #define KARPLUSPLUS_FLATTEN __attribute__ ((flatten)) // Inlines the header bodies, so they are compiled for the variant too
+#else
+ // MSVC and ARM: no per-function targets, every slot gets the generic build
+ #define KARPLUSPLUS_DISPATCH 0
+ #define KARPLUSPLUS_INLINE inline
+ #define KARPLUSPLUS_FLATTEN
+#endif
+
+namespace
+{
+    // ====== KERNEL BODIES - PLAIN LOOPS, VECTORISED BY THE COMPILER FOR EACH TARGET =======
+    KARPLUSPLUS_INLINE void addWithGainImpl (float* dest, const float* src, float gain, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            dest[i] += src[i] * gain;
+    }
+
+    // Same rounding as Delay::toCompact - nearbyint rather than lrintf, which does not vectorise
+    KARPLUSPLUS_INLINE void toCompactImpl (int16_t* dest, const float* src, const float* dither, float scale, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float scaled = src[i] * scale + 0.5f * dither[i];
+            scaled = std::min (32767.0f, std::max (-32767.0f, scaled));
+            dest[i] = (int16_t) std::nearbyint (scaled);
+        }
+    }
+
+    // ====== NOISE LCG - x' = a * x + c, AND THE SAME STEP TAKEN n TIMES =======
+    constexpr uint32_t lcgMultiplier = 1664525u, lcgIncrement = 1013904223u;
+
+    struct LcgJump
+    {
+        uint32_t multiplier = 1, increment = 0; // x' = multiplier * x + increment
+
+        constexpr LcgJump (uint32_t numSteps) // a^n and c (a^n - 1) / (a - 1), by squaring
+        {
+            uint32_t stepMultiplier = lcgMultiplier, stepIncrement = lcgIncrement;
+
+            for (; numSteps > 0; numSteps >>= 1)
+            {
+                if (numSteps & 1u)
+                {
+                    multiplier *= stepMultiplier;
+                    increment = increment * stepMultiplier + stepIncrement;
+                }
+
+                stepIncrement = (stepMultiplier + 1u) * stepIncrement;
+                stepMultiplier *= stepMultiplier;
+            }
+        }
+
+        constexpr uint32_t apply (uint32_t state) const { return multiplier * state + increment; }
+    };
+
+    KARPLUSPLUS_INLINE void whiteNoiseImpl (float* dest, uint32_t& state, int numSamples)
+    {
+        // Lane l starts l + 1 steps ahead and every lane jumps 8 steps at a time, so the lanes have no serial
+        // dependency and together still produce the scalar LCG sequence, sample for sample
+        constexpr LcgJump jump8 (8);
+        uint32_t lanes[8];
+        uint32_t seed = state;
+
+        for (int l = 0; l < 8; ++l)
+        {
+            seed = seed * lcgMultiplier + lcgIncrement;
+            lanes[l] = seed;
+        }
+
+        int i = 0;
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            for (int l = 0; l < 8; ++l)
+            {
+                dest[i + l] = (float) (int32_t) lanes[l] * (1.0f / 2147483648.0f);
+                lanes[l] = jump8.apply (lanes[l]);
+            }
+        }
+
+        for (int l = 0; i < numSamples; ++i, ++l)
+            dest[i] = (float) (int32_t) lanes[l] * (1.0f / 2147483648.0f);
+
+        state = LcgJump ((uint32_t) juce::jmax (0, numSamples)).apply (state); // The last value written
+    }
+
+    KARPLUSPLUS_INLINE float loopFilterLanesImpl (float* taps, float* lpState, const float* gain, float coeff, int numLanes)
+    {
+        float sum = 0.0f;
+
+        for (int s = 0; s < numLanes; ++s)
+        {
+            lpState[s] += coeff * (taps[s] - lpState[s]);
+            taps[s] = lpState[s] * gain[s];
+            sum += taps[s];
+        }
+
+        return sum;
+    }
+
+    KARPLUSPLUS_INLINE float modalStepImpl (const float* coeffRe, const float* coeffIm, float* stateRe, float* stateIm,
+                                            const float* gain, float input, int numModes)
+    {
+        float out = 0.0f;
+
+        for (int m = 0; m < numModes; ++m)
+        {
+            const float re = coeffRe[m] * stateRe[m] - coeffIm[m] * stateIm[m] + gain[m] * input;
+            const float im = coeffRe[m] * stateIm[m] + coeffIm[m] * stateRe[m];
+
+            stateRe[m] = re;
+            stateIm[m] = im;
+            out += im;
+        }
+
+        return out;
+    }
+
+    // JUCE_SNAP_TO_ZERO as a select rather than a branch, so the lanes stay in one vector - NaN goes to 0 in both
+    KARPLUSPLUS_INLINE float snapToZero (float x)
+    {
+        return std::abs (x) > 1.0e-8f ? x : 0.0f;
+    }
+
+    // Saturator::processSample for one lane - the shape and order are the same on every lane
+    template <SaturationShape shape, Antialiasing antialiasing>
+    KARPLUSPLUS_INLINE float saturateLane (StringLanes& l, int s, float y)
+    {
+        if (antialiasing == Antialiasing::off)
+            return shape == SaturationShape::clip ? (y > 1.0f ? 1.0f : (y < -1.0f ? -1.0f : y)) : (float) Saturator::apply (shape, y);
+
+        const double x = y;
+        const double out = antialiasing == Antialiasing::firstOrder ? Saturator::firstOrder<shape> (x, l.saturatorX1[s])
+                                                                    : Saturator::secondOrder<shape> (x, l.saturatorX1[s], l.saturatorX2[s]);
+        l.saturatorX2[s] = l.saturatorX1[s];
+        l.saturatorX1[s] = x;
+        return (float) out;
+    }
+
+    // Same loop body as StringLoop, written so every lane takes the same path
+    template <SaturationShape shape, Antialiasing antialiasing>
+    KARPLUSPLUS_INLINE void stringLanesImpl (StringLanes& l, float input, float feedback, float& left, float& right)
+    {
+        const float b0 = l.coeffs[0], b1 = l.coeffs[1], b2 = l.coeffs[2], a1 = l.coeffs[3], a2 = l.coeffs[4];
+        alignas (32) float outs[StringLanes::maxLanes];
+
+        for (int s = 0; s < StringLanes::maxLanes; ++s)
+        {
+            // Non-linear allpass - the coefficients flip or close on the sign of the input
+            const float x = l.tap[s];
+            const float gate = x + l.allpassY[s] >= 0.0f ? 0.0f : 1.0f;
+            l.allpassA[s] *= -gate;
+            l.allpassB[s] *= -gate;
+            const float c = l.allpassA[s] + l.allpassB[s];
+            float y = c * x + l.allpassX[s] - c * l.allpassY[s];
+            l.allpassX[s] = x;
+            l.allpassY[s] = y;
+
+            y = saturateLane<shape, antialiasing> (l, s, y);
+
+            // Loop lowpass - stepped twice per sample like StringLoop::dampen. Only the state is snapped: snapping
+            // the outputs too puts two selects into the recursion and costs 70% here
+            const float out = b0 * y + l.v1[s];
+            float v1 = b1 * y - a1 * out + l.v2[s];
+            float v2 = b2 * y - a2 * out;
+
+            const float again = b0 * out + v1;
+            v1 = b1 * out - a1 * again + v2;
+            v2 = b2 * out - a2 * again;
+
+            l.v1[s] = snapToZero (v1); // A decaying tail never runs into denormals
+            l.v2[s] = snapToZero (v2);
+
+            l.tap[s] = input * l.active[s] + feedback * out;
+            outs[s] = out;
+        }
+
+        // Panning reduces across lanes, so it stays out of the loop above
+        float sumLeft = 0.0f, sumRight = 0.0f;
+
+        for (int s = 0; s < StringLanes::maxLanes; ++s)
+        {
+            sumLeft += outs[s] * l.panLeft[s];
+            sumRight += outs[s] * l.panRight[s];
+        }
+
+        left += sumLeft;
+        right += sumRight;
+    }
+
+    // The settings switch once per sample for all lanes, outside the lane loop
+    template <SaturationShape shape>
+    KARPLUSPLUS_INLINE void stringLanesImpl (StringLanes& l, float input, float feedback, float& left, float& right)
+    {
+        switch (l.antialiasing)
+        {
+            case Antialiasing::firstOrder:  stringLanesImpl<shape, Antialiasing::firstOrder> (l, input, feedback, left, right); break;
+            case Antialiasing::secondOrder: stringLanesImpl<shape, Antialiasing::secondOrder> (l, input, feedback, left, right); break;
+            case Antialiasing::off:         stringLanesImpl<shape, Antialiasing::off> (l, input, feedback, left, right); break;
+        }
+    }
+
+    KARPLUSPLUS_INLINE void stringLanesImpl (StringLanes& l, float input, float feedback, float& left, float& right)
+    {
+        switch (l.shape)
+        {
+            case SaturationShape::fold: stringLanesImpl<SaturationShape::fold> (l, input, feedback, left, right); break;
+            case SaturationShape::tanh: stringLanesImpl<SaturationShape::tanh> (l, input, feedback, left, right); break;
+            case SaturationShape::clip: stringLanesImpl<SaturationShape::clip> (l, input, feedback, left, right); break;
+        }
+    }
+
+    // ====== ONE SET OF ENTRY POINTS PER INSTRUCTION SET =======
+    // stringLoop is one latency bound recursion with nothing to vectorise, so it is not flattened and every slot
+    // shares the generic body - flattened, the nine saturation paths spilled the filter state and halved its speed.
+   #define KARPLUSPLUS_KERNEL_SET(suffix, attribute) \
+    attribute void addWithGain##suffix (float* d, const float* s, float g, int n)        { addWithGainImpl (d, s, g, n); } \
+    attribute void whiteNoise##suffix (float* d, uint32_t& st, int n)                    { whiteNoiseImpl (d, st, n); } \
+    attribute float loopFilterLanes##suffix (float* t, float* lp, const float* g, float c, int n) { return loopFilterLanesImpl (t, lp, g, c, n); } \
+    attribute float modalStep##suffix (const float* cr, const float* ci, float* sr, float* si, const float* g, float in, int n) \
+                                                                                           { return modalStepImpl (cr, ci, sr, si, g, in, n); } \
+    attribute void stringLanes##suffix (StringLanes& l, float in, float fb, float& lo, float& ro) { stringLanesImpl (l, in, fb, lo, ro); } \
+    attribute void stringLoop##suffix (StringLoop& l, float* d, int n)                    { l.process (d, n); } \
+    attribute KARPLUSPLUS_FLATTEN void saturate##suffix (Saturator& s, float* d, int n)    { s.processSpan (d, n); } \
+    attribute void toCompact##suffix (int16_t* d, const float* s, const float* di, float k, int n) { toCompactImpl (d, s, di, k, n); }
+
+    KARPLUSPLUS_KERNEL_SET (Generic, )
+
+   #if KARPLUSPLUS_DISPATCH
+    KARPLUSPLUS_KERNEL_SET (Sse2, KARPLUSPLUS_TARGET ("sse2"))
+    KARPLUSPLUS_KERNEL_SET (Avx2, KARPLUSPLUS_TARGET ("avx2,fma"))
+    KARPLUSPLUS_KERNEL_SET (Avx512, KARPLUSPLUS_TARGET ("avx512f,avx2,fma"))
+   #endif
+
+   #define KARPLUSPLUS_KERNEL_TABLE(isaValue, label, suffix) \
+    { isaValue, label, addWithGain##suffix, whiteNoise##suffix, loopFilterLanes##suffix, modalStep##suffix, stringLanes##suffix, \
+      stringLoop##suffix, saturate##suffix, toCompact##suffix }
+
+    const DspKernels kernelTables[] =
+    {
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::generic, "generic", Generic),
+       #if KARPLUSPLUS_DISPATCH
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::sse2,    "sse2",    Sse2),
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::avx2,    "avx2",    Avx2),
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::avx512,  "avx512",  Avx512),
+       #else
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::sse2,    "generic", Generic),
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::avx2,    "generic", Generic),
+        KARPLUSPLUS_KERNEL_TABLE (DspKernels::Isa::avx512,  "generic", Generic),
+       #endif
+    };
+
+    bool cpuSupports (DspKernels::Isa isa)
+    {
+        switch (isa)
+        {
+            case DspKernels::Isa::generic: return true;
+            case DspKernels::Isa::sse2:    return juce::SystemStats::hasSSE2();
+            case DspKernels::Isa::avx2:    return juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3();
+            case DspKernels::Isa::avx512:  return juce::SystemStats::hasAVX512F() && juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3();
+        }
+
+        return false;
+    }
+}
+
+// ====== SELECTION =======
+const DspKernels& DspKernels::select()
+{
+    Isa best = Isa::generic;
+
+    for (auto isa : { Isa::sse2, Isa::avx2, Isa::avx512 })
+        if (cpuSupports (isa))
+            best = isa;
+
+    // Override for benchmarking - ignored if the CPU cannot run the requested variant
+    const juce::String requested = juce::SystemStats::getEnvironmentVariable ("KARPLUSPLUS_ISA", {}).toLowerCase();
+
+    for (auto& table : kernelTables)
+        if (requested == table.name && cpuSupports (table.isa))
+            best = table.isa;
+
+    const DspKernels* chosen = &kernelTables[(int) best];
+    current().store (chosen, std::memory_order_release);
+
+    DBG ("DSP kernels: " << chosen->name);
+    return *chosen;
+}
+
+bool DspKernels::forceIsa (Isa isa)
+{
+    if (! cpuSupports (isa))
+        return false;
+
+    current().store (&kernelTables[(int) isa], std::memory_order_release);
+    return true;
+}
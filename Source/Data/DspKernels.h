@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// ====== CPU FEATURE DISPATCH FOR THE HOT LOOPS =======
+// Every kernel is compiled once per instruction set in DspKernels.cpp. The best variant the CPU supports
+// is picked once when the plugin is loaded, so one binary runs on old machines and uses AVX-512 where it can.
+// Set the environment variable KARPLUSPLUS_ISA (generic, sse2, avx2, avx512) or call forceIsa() to benchmark a variant.
+
+struct StringLoop; // StringModel.h
+class Saturator; // Saturators.h
+enum class SaturationShape; // Saturators.h
+enum class Antialiasing;
+
+// ====== A STACK OF KARPLUS STRONG LOOPS - ONE LANE PER STRING, ALWAYS maxLanes WIDE =======
+struct StringLanes
+{
+    static constexpr int maxLanes = 8; // One AVX register
+
+    alignas (32) float tap[maxLanes] {}; // In: delay line output, out: value to write back
+    alignas (32) float allpassX[maxLanes] {};
+    alignas (32) float allpassY[maxLanes] {};
+    alignas (32) float allpassA[maxLanes] {};
+    alignas (32) float allpassB[maxLanes] {};
+    alignas (32) float v1[maxLanes] {}; // Loop lowpass state, transposed direct form II
+    alignas (32) float v2[maxLanes] {};
+    alignas (32) float active[maxLanes] {}; // 0 for unused lanes - they never get excited
+    alignas (32) float panLeft[maxLanes] {};
+    alignas (32) float panRight[maxLanes] {};
+    alignas (32) double saturatorX1[maxLanes] {}; // ADAA input history - double like Saturator
+    alignas (32) double saturatorX2[maxLanes] {};
+    float coeffs[5] {}; // Lowpass shared by all lanes - b0, b1, b2, a1, a2 like juce::IIRCoefficients
+    SaturationShape shape {}; // Shared by all lanes like the lowpass - clip and no anti-aliasing by default
+    Antialiasing antialiasing {};
+};
+
+struct DspKernels
+{
+    enum class Isa
+    {
+        generic = 0,
+        sse2,
+        avx2,
+        avx512
+    };
+
+    Isa isa;
+    const char* name;
+
+    // ====== MIX-DOWN: dest += src * gain =======
+    void (*addWithGain) (float* dest, const float* src, float gain, int numSamples);
+
+    // ====== NOISE: uniform white noise in -1..1, the same values as stepping the LCG state once per sample =======
+    void (*whiteNoise) (float* dest, uint32_t& state, int numSamples);
+
+    // ====== LOOP FILTER: one pole lowpass and gain across string lanes, returns the sum of all lanes =======
+    float (*loopFilterLanes) (float* taps, float* lpState, const float* gain, float coeff, int numLanes);
+
+    // ====== MODAL BANK: one step of a bank of complex one poles, returns the sum of the imaginary parts =======
+    float (*modalStep) (const float* coeffRe, const float* coeffIm, float* stateRe, float* stateIm,
+                        const float* gain, float input, int numModes);
+
+    // ====== UNISON: one step of every string lane, adds the panned lanes to left and right =======
+    void (*stringLanes) (StringLanes& lanes, float input, float feedback, float& left, float& right);
+
+    // ====== STRING LOOP: allpass, saturation and lowpass over a span read from the delay line, in place =======
+    void (*stringLoop) (StringLoop& loop, float* data, int numSamples);
+
+    // ====== SATURATION: the saturator's shape and antialiasing over a span, in place =======
+    void (*saturate) (Saturator& saturator, float* data, int numSamples);
+
+    // ====== INT16 DELAY STORAGE: dest = round (src * scale + dither / 2), saturated - dither from whiteNoise =======
+    void (*toCompact) (int16_t* dest, const float* src, const float* dither, float scale, int numSamples);
+
+    // ====== SELECTION =======
+    static const DspKernels& get()
+    {
+        const DspKernels* k = current().load (std::memory_order_acquire);
+        return k != nullptr ? *k : select();
+    }
+
+    static const DspKernels& select(); // Reads CPUID and the KARPLUSPLUS_ISA override
+    static bool forceIsa (Isa isa); // Returns false if the CPU cannot run that variant
+
+private:
+    static std::atomic<const DspKernels*>& current()
+    {
+        static std::atomic<const DspKernels*> kernels { nullptr };
+        return kernels;
+    }
+};
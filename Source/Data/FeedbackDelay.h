@@ -1,5 +1,22 @@
 #pragma once
 #include <cmath> // Used for tanh()
+#include <cstdint> // Used for int16_t
+#include "DspKernels.h"
+
+// ====== STORAGE FORMAT OF THE CIRCULAR BUFFER =======
+enum class DelayStorage
+{
+    float32, // Full precision - 4 bytes per tap
+    int16    // Scaled int16 with dithered write-back - 2 bytes per tap
+};
+
+// ====== INTERPOLATION OF FRACTIONAL READS =======
+enum class DelayInterpolation
+{
+    linear,    // Two taps - cheapest, slight high frequency loss
+    lagrange3, // Four taps - flat response, default
+    allpass    // Two taps and one state - no loss, best for slow modulation
+};
 
 class Delay
 {
@@ -8,10 +25,7 @@ public:
     // ====== CONSTRUCTOR / DESTRUCTOR =======
     Delay() {}
     
-    virtual ~Delay()
-    {
-        delete buffer;      // clean up when the object is destroyed to avoid memory leaks
-    }
+    virtual ~Delay() {}
     
     // ====== SETTER FUNCTIONS =======
     void setSamplerate (float samplerate)
@@ -25,14 +39,34 @@ public:
         smoothFeedback.setCurrentAndTargetValue (0.0);
     }
     
+    void setStorage (DelayStorage newStorage) // Call before setSize()
+    {
+        storage = newStorage;
+    }
+    
+    void setInterpolation (DelayInterpolation newInterpolation)
+    {
+        interpolation = newInterpolation;
+    }
+    
     void setSize(float newSize)
     {
         size = newSize; // Assign to private member variable
-        buffer = new float[size]; // Buffer size
-        for (int i = 0; i < size; i++) // Iterate through size of buffer
+
+        // Only the buffer of the chosen format is allocated - the other one is released
+        if (storage == DelayStorage::int16)
+        {
+            compactBuffer.calloc (size);
+            buffer.free();
+        }
+        else
         {
-            buffer[i] = 0.0f;
+            buffer.calloc (size);
+            compactBuffer.free();
         }
+
+        writePos = 0;
+        readPos = 0;
     }
     
     void setDelayTimeInSamples (float delTime)
@@ -61,7 +95,8 @@ public:
     // ====== UTILITY FUNCTIONS =======
     float readVal()
     {
-        float outVal = buffer[readPos]; // Output read position
+        float outVal = storage == DelayStorage::int16 ? fromCompact (compactBuffer[readPos])
+                                                      : buffer[readPos]; // Output read position
         readPos++; // Increment read position
         readPos %= size; // Set read position relative to max size
         return outVal;
@@ -69,11 +104,129 @@ public:
 
     void writeVal(float inSamp)
     {
-        buffer[writePos] = inSamp; // write into buffer
+        if (storage == DelayStorage::int16)
+            compactBuffer[writePos] = toCompact (inSamp, nextDither());
+        else
+            buffer[writePos] = inSamp; // write into buffer
+
         writePos++;  // Increment write position
         writePos %= size; // Set write position relative to max size
     }
     
+    // ====== FRACTIONAL READ - delayInSamples BEHIND THE NEXT WRITE, CALL ONCE PER SAMPLE BEFORE writeVal() =======
+    float readFractional (float delayInSamples)
+    {
+        switch (interpolation)
+        {
+            case DelayInterpolation::linear:  return readFractional<DelayInterpolation::linear> (delayInSamples);
+            case DelayInterpolation::allpass: return readFractional<DelayInterpolation::allpass> (delayInSamples);
+            default:                          return readFractional<DelayInterpolation::lagrange3> (delayInSamples);
+        }
+    }
+
+    // Per-sample loops switch on the mode once and call this directly
+    template <DelayInterpolation mode>
+    float readFractional (float delayInSamples)
+    {
+        delayInSamples = juce::jlimit (2.0f, (float) (size - 3), delayInSamples); // Room for the outer Lagrange taps
+
+        if constexpr (mode == DelayInterpolation::allpass)
+        {
+            // The taps stay put while the allpass delay is within 0.5-2.5, so vibrato around a half sample never
+            // swaps the tap pair under the allpass state. Only a bend past that moves them, to the middle of the range.
+            float frac = delayInSamples - (float) allpassWhole;
+
+            if (frac < 0.5f || frac > 2.5f)
+            {
+                allpassWhole = (int) delayInSamples - 1;
+                frac = delayInSamples - (float) allpassWhole;
+            }
+
+            const float a = (1.0f - frac) / (1.0f + frac);
+            allpassState = a * readDelayed (allpassWhole) + readDelayed (allpassWhole + 1) - a * allpassState;
+            return allpassState;
+        }
+
+        const int whole = (int) delayInSamples;
+        const float frac = delayInSamples - (float) whole;
+
+        if constexpr (mode == DelayInterpolation::linear)
+        {
+            const float x0 = readDelayed (whole);
+            return x0 + frac * (readDelayed (whole + 1) - x0);
+        }
+
+        // Third order Lagrange through the taps at whole - 1 .. whole + 2
+        const float xm1 = readDelayed (whole - 1);
+        const float x0 = readDelayed (whole);
+        const float x1 = readDelayed (whole + 1);
+        const float x2 = readDelayed (whole + 2);
+
+        const float dm1 = frac + 1.0f, d1 = frac - 1.0f, d2 = frac - 2.0f;
+        return -xm1 * frac * d1 * d2 * (1.0f / 6.0f)
+               + x0 * dm1 * d1 * d2 * 0.5f
+               - x1 * dm1 * frac * d2 * 0.5f
+               + x2 * dm1 * frac * d1 * (1.0f / 6.0f);
+    }
+
+    void resetFractionalRead() // New note - the allpass starts from silence and picks its taps again
+    {
+        allpassState = 0.0f;
+        allpassWhole = -1;
+    }
+    
+    // ====== BLOCK READ / WRITE - CONVERSION HAPPENS IN REGISTERS =======
+    void readBlock (float* dest, int numSamples)
+    {
+        while (numSamples > 0)
+        {
+            const int span = std::min (numSamples, size - readPos); // Contiguous part up to the wrap point
+
+            if (storage == DelayStorage::int16)
+            {
+                const int16_t* src = compactBuffer + readPos;
+                for (int i = 0; i < span; ++i) // Plain loop so the compiler can vectorise the conversion
+                    dest[i] = (float) src[i] * compactToFloat;
+            }
+            else
+            {
+                juce::FloatVectorOperations::copy (dest, buffer + readPos, span);
+            }
+
+            readPos = (readPos + span) % size;
+            dest += span;
+            numSamples -= span;
+        }
+    }
+
+    void writeBlock (const float* src, int numSamples)
+    {
+        while (numSamples > 0)
+        {
+            const int span = std::min (numSamples, size - writePos);
+
+            if (storage == DelayStorage::int16)
+            {
+                // The dither is drawn for the whole chunk first, so the conversion is one plain loop
+                for (int done = 0; done < span; done += ditherChunk)
+                {
+                    const int chunk = std::min (ditherChunk, span - done);
+                    float dither[ditherChunk];
+                    kernels->whiteNoise (dither, ditherState, chunk); // The same draws as nextDither()
+                    kernels->toCompact (compactBuffer + writePos + done, src + done, dither, floatToCompact, chunk);
+                }
+            }
+            else
+            {
+                juce::FloatVectorOperations::copy (buffer + writePos, src, span);
+            }
+
+            writePos = (writePos + span) % size;
+            src += span;
+            numSamples -= span;
+        }
+    }
+    
     // ====== CIRCULAR BUFFER - CAN BE REPLACED OR RE-USED =======
     virtual float process (float& inSamp)
     {
@@ -83,8 +236,28 @@ public:
         return floor;
     }
     
+    // ====== INT16 CONVERSION - SHARED WITH THE UNISON LANES =======
+    // The loop saturates at +-1 before the lowpass, so the line only holds that plus the excitation
+    static constexpr float compactRange = 2.0f; // Full scale
+    static constexpr float floatToCompact = 32767.0f / compactRange;
+    static constexpr float compactToFloat = compactRange / 32767.0f;
+    
+    static int16_t toCompact (float value, float dither) // dither in LSB - DspKernels::toCompact does the same
+    {
+        float scaled = value * floatToCompact + dither;
+        scaled = std::min (32767.0f, std::max (-32767.0f, scaled)); // Saturate instead of wrapping
+        return (int16_t) std::nearbyint (scaled);
+    }
+    
+    static float fromCompact (int16_t value)
+    {
+        return (float) value * compactToFloat;
+    }
+    
 protected:
-    float* buffer; // Pointer to a buffer - should be uniquePtr
+    juce::HeapBlock<float> buffer; // 32-bit storage
+    juce::HeapBlock<int16_t> compactBuffer; // 16-bit storage
+    DelayStorage storage = DelayStorage::float32;
     int size; // Buffer Size
     
     int writePos = 0;  // Write Position
@@ -98,5 +271,29 @@ protected:
 
     int sr; // Samplerate
     
+    DelayInterpolation interpolation = DelayInterpolation::lagrange3;
+    float allpassState = 0.0f; // Output history of the allpass interpolator
+    int allpassWhole = -1; // Its tap pair - -1 picks one on the next read
+    
+    float readDelayed (int delay) const // Tap written delay samples ago
+    {
+        int pos = writePos - delay;
+        if (pos < 0)
+            pos += size;
+
+        return storage == DelayStorage::int16 ? fromCompact (compactBuffer[pos]) : buffer[pos];
+    }
+    
+    // Rectangular dither of +-0.5 LSB, one LCG draw like DspKernels::whiteNoise. Inside a feedback loop TPDF
+    // dither piles up every period into a noise floor at the loop pitch; this only breaks up limit cycles.
+    float nextDither()
+    {
+        ditherState = ditherState * 1664525u + 1013904223u;
+        return (float) (int32_t) ditherState * (0.5f / 2147483648.0f);
+    }
+    
+    static constexpr int ditherChunk = 64;
+    uint32_t ditherState = 22222u;
+    const DspKernels* kernels = &DspKernels::get();
 };
 
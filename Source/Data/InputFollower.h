@@ -0,0 +1,82 @@
+#pragma once
+#include <cmath>
+
+// ====== INPUT FOLLOWER - PLAYS THE STRINGS FROM THE SIDECHAIN =======
+// Peak envelope of the excitation input. Each time it rises through the threshold a note on is written into
+// the MIDI buffer at that sample; the matching note off follows once it has fallen 6dB below.
+class InputFollower
+{
+public:
+    // ====== SETUP =======
+    void prepare (double sampleRate)
+    {
+        releaseCoeff = std::exp (-1.0f / (0.05f * (float) sampleRate)); // 50ms fall
+        minGapSamples = (int) (0.03 * sampleRate); // Retrigger no faster than every 30ms
+        reset();
+    }
+
+    void reset()
+    {
+        envelope = 0.0f;
+        gateOpen = false;
+        samplesSinceTrigger = 0;
+        heldNote = -1;
+    }
+
+    void setThreshold (float thresholdDb)
+    {
+        openThreshold = juce::Decibels::decibelsToGain (thresholdDb);
+        closeThreshold = openThreshold * 0.5f; // Hysteresis - fluttering input does not retrigger
+    }
+
+    // ====== SCAN ONE BLOCK - TRIGGERS ARE SAMPLE ACCURATE =======
+    void process (const float* input, int numSamples, juce::MidiBuffer& midi, int note)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float rectified = std::abs (input[i]);
+            envelope = rectified > envelope ? rectified : envelope * releaseCoeff; // Instant attack catches transients
+            ++samplesSinceTrigger;
+
+            if (! gateOpen && envelope > openThreshold && samplesSinceTrigger > minGapSamples)
+            {
+                if (heldNote >= 0)
+                    midi.addEvent (juce::MidiMessage::noteOff (midiChannel, heldNote), i);
+
+                midi.addEvent (juce::MidiMessage::noteOn (midiChannel, note, juce::jlimit (0.1f, 1.0f, envelope)), i);
+                heldNote = note; // Note off goes to this note even if the parameter changes meanwhile
+                gateOpen = true;
+                samplesSinceTrigger = 0;
+            }
+            else if (gateOpen && envelope < closeThreshold)
+            {
+                midi.addEvent (juce::MidiMessage::noteOff (midiChannel, heldNote), i);
+                heldNote = -1;
+                gateOpen = false;
+            }
+        }
+    }
+
+    // ====== RELEASES A HELD NOTE - E.G. WHEN THE FOLLOWER IS SWITCHED OFF =======
+    void releaseNote (juce::MidiBuffer& midi)
+    {
+        if (heldNote >= 0)
+            midi.addEvent (juce::MidiMessage::noteOff (midiChannel, heldNote), 0);
+
+        heldNote = -1;
+        gateOpen = false;
+    }
+
+private:
+    float envelope = 0.0f;
+    float releaseCoeff = 0.999f;
+    float openThreshold = 0.03f;
+    float closeThreshold = 0.015f;
+
+    bool gateOpen = false;
+    int samplesSinceTrigger = 0;
+    int minGapSamples = 1440;
+    int heldNote = -1;
+
+    static constexpr int midiChannel = 1;
+};
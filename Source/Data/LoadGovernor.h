@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+
+// ====== LOAD-ADAPTIVE QUALITY GOVERNOR =======
+// Measures each callback against the real-time budget of its block. Under pressure the tier steps up one
+// stage at a time; it only steps back down after the load has stayed low for a while (hysteresis).
+class LoadGovernor
+{
+public:
+    enum Tier
+    {
+        fullQuality = 0,
+        cappedPolyphony,  // Quietest voices above the cap are retired
+        retiredTails,     // Released notes below -30dB are retired, lower cap
+        noResonance,      // Sympathetic strings bypassed
+        noAnalyser,       // GUI analyser no longer fed
+        numTiers
+    };
+
+    static const char* getTierName (int tier)
+    {
+        static const char* names[numTiers] = { "Full quality", "Capped polyphony", "Retiring tails", "No sympathetic strings", "No analyser" };
+        return names[juce::jlimit (0, numTiers - 1, tier)];
+    }
+
+    // ====== SETUP =======
+    void prepare (double sampleRate, int samplesPerBlock)
+    {
+        sr = sampleRate;
+        smoothedLoad = 0.0f;
+        blocksSinceChange = 0;
+        blocksBelow = 0;
+        holdBlocks = juce::jmax (1, (int) (holdSeconds * sampleRate / juce::jmax (1, samplesPerBlock)));
+        tier.store (fullQuality);
+    }
+
+    // ====== MEASUREMENT - CALL AT THE START AND END OF EVERY CALLBACK =======
+    void beginBlock()
+    {
+        startTicks = juce::Time::getHighResolutionTicks();
+    }
+
+    void endBlock (int numSamples)
+    {
+        if (numSamples <= 0)
+            return;
+
+        const double elapsed = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+        const float blockLoad = (float) (elapsed / ((double) numSamples / sr)); // 1.0 = deadline reached
+
+        // Fast attack, slow release - spikes count straight away
+        smoothedLoad = blockLoad > smoothedLoad ? blockLoad : smoothedLoad + 0.05f * (blockLoad - smoothedLoad);
+        load.store (smoothedLoad);
+
+        ++blocksSinceChange;
+        int current = tier.load();
+
+        if (smoothedLoad > raiseThreshold && current < numTiers - 1 && blocksSinceChange > settleBlocks)
+        {
+            tier.store (current + 1); // One step at a time, then let the load settle
+            blocksSinceChange = 0;
+            blocksBelow = 0;
+        }
+        else if (smoothedLoad < lowerThreshold && current > fullQuality)
+        {
+            if (++blocksBelow >= holdBlocks)
+            {
+                tier.store (current - 1);
+                blocksSinceChange = 0;
+                blocksBelow = 0;
+            }
+        }
+        else
+        {
+            blocksBelow = 0;
+        }
+    }
+
+    void reset() // Offline renders have no deadline
+    {
+        tier.store (fullQuality);
+        blocksBelow = 0;
+    }
+
+    // ====== STATE - SAFE TO READ FROM ANY THREAD =======
+    int getTier() const { return tier.load(); }
+    float getLoad() const { return load.load(); }
+
+    int getVoiceCap (int numVoices) const
+    {
+        const int current = tier.load();
+
+        if (current >= retiredTails)
+            return numVoices / 2;
+        if (current >= cappedPolyphony)
+            return (numVoices * 2) / 3;
+
+        return numVoices;
+    }
+
+private:
+    std::atomic<int> tier { fullQuality };
+    std::atomic<float> load { 0.0f };
+
+    juce::int64 startTicks = 0;
+    double sr = 44100.0;
+    float smoothedLoad = 0.0f;
+
+    int blocksSinceChange = 0;
+    int blocksBelow = 0;
+    int holdBlocks = 100;
+
+    static constexpr float raiseThreshold = 0.7f;  // Fraction of the block budget
+    static constexpr float lowerThreshold = 0.4f;
+    static constexpr double holdSeconds = 2.0;    // Load must stay low this long before quality is restored
+    static constexpr int settleBlocks = 4;
+};
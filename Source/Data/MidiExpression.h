@@ -0,0 +1,145 @@
+#pragma once
+
+// ====== PER-CHANNEL EXPRESSION AS SAMPLE-STAMPED RAMPS =======
+// juce::Synthesiser splits its render at every MIDI event, so a dense stream of MPE pitch bend, pressure and
+// timbre would chop every voice into slivers of a few samples. Instead these events are taken out of the block
+// up front and kept as a short list of breakpoints per channel; the value ramps linearly from one to the next.
+// Voices look the value up once per control chunk - they never see the individual events.
+class MidiExpression
+{
+public:
+    enum Dimension
+    {
+        pitchBend = 0, // -1 to 1
+        pressure,      // 0 to 1 - channel pressure
+        timbre,        // 0 to 1 - CC74, 0.5 is neutral
+        numDimensions
+    };
+
+    static constexpr int numChannels = 16;
+    static constexpr int maxPoints = 32; // Per channel, dimension and block - denser input keeps only the latest value
+
+    // ====== SETUP =======
+    void prepare()
+    {
+        remaining.ensureSize (4096);
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& channel : lanes)
+        {
+            for (int d = 0; d < numDimensions; ++d)
+            {
+                channel[d].start = getNeutralValue (d);
+                channel[d].numPoints = 0;
+            }
+        }
+    }
+
+    static float getNeutralValue (int dimension) { return dimension == timbre ? 0.5f : 0.0f; }
+
+    // ====== TAKES THE EXPRESSION EVENTS OUT OF THE BLOCK - EVERYTHING ELSE STAYS =======
+    // positionScale maps event positions to the rate the voices render at, e.g. for oversampled renders
+    void extract (juce::MidiBuffer& midi, int positionScale)
+    {
+        for (auto& channel : lanes)
+        {
+            for (auto& lane : channel)
+            {
+                if (lane.numPoints > 0)
+                    lane.start = lane.points[lane.numPoints - 1].value; // Carries on from where the last block ended
+
+                lane.numPoints = 0;
+            }
+        }
+
+        remaining.clear();
+        bool found = false;
+
+        for (const auto metadata : midi)
+        {
+            const auto message = metadata.getMessage();
+            const int channel = message.getChannel() - 1;
+            const int position = metadata.samplePosition * positionScale;
+
+            if (message.isPitchWheel())
+                addPoint (channel, pitchBend, position, (float) (message.getPitchWheelValue() - 8192) / 8192.0f);
+            else if (message.isChannelPressure())
+                addPoint (channel, pressure, position, (float) message.getChannelPressureValue() / 127.0f);
+            else if (message.isController() && message.getControllerNumber() == 74)
+                addPoint (channel, timbre, position, (float) message.getControllerValue() / 127.0f);
+            else
+            {
+                remaining.addEvent (message, metadata.samplePosition);
+                continue;
+            }
+
+            found = true;
+        }
+
+        if (found)
+            midi.swapWith (remaining);
+    }
+
+    // ====== LOOKUP - channel IS 1-16 LIKE IN juce::MidiMessage =======
+    float getValue (int channel, int dimension, int sample) const
+    {
+        const Lane& lane = lanes[juce::jlimit (0, numChannels - 1, channel - 1)][dimension];
+
+        int previousSample = 0;
+        float previousValue = lane.start;
+
+        for (int p = 0; p < lane.numPoints; ++p)
+        {
+            const Point& point = lane.points[p];
+
+            if (sample < point.sample)
+                return previousValue + (point.value - previousValue) * (float) (sample - previousSample) / (float) (point.sample - previousSample);
+
+            previousSample = point.sample;
+            previousValue = point.value;
+        }
+
+        return previousValue;
+    }
+
+    bool isMoving (int channel) const // Any breakpoint this block
+    {
+        const auto& lanesOfChannel = lanes[juce::jlimit (0, numChannels - 1, channel - 1)];
+        return lanesOfChannel[pitchBend].numPoints + lanesOfChannel[pressure].numPoints + lanesOfChannel[timbre].numPoints > 0;
+    }
+
+private:
+    struct Point
+    {
+        int sample;
+        float value;
+    };
+
+    struct Lane
+    {
+        float start = 0.0f; // Value at the start of the block
+        Point points[maxPoints];
+        int numPoints = 0;
+    };
+
+    void addPoint (int channel, int dimension, int sample, float value)
+    {
+        if (channel < 0 || channel >= numChannels)
+            return;
+
+        Lane& lane = lanes[channel][dimension];
+
+        if (lane.numPoints > 0 && lane.points[lane.numPoints - 1].sample >= sample)
+            lane.points[lane.numPoints - 1].value = value; // Same sample - the latest event wins
+        else if (lane.numPoints == maxPoints)
+            lane.points[maxPoints - 1] = { sample, value }; // Full - move the last breakpoint instead of adding one
+        else
+            lane.points[lane.numPoints++] = { sample, value };
+    }
+
+    Lane lanes[numChannels][numDimensions];
+    juce::MidiBuffer remaining; // Preallocated - extract() never allocates
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include "DspKernels.h"
+#include <cmath>
+
+// ====== MODAL RESONATOR BANK =======
+// Alternative to the delay line strings: each partial of the note is a damped complex one pole.
+// Memory is a few hundred bytes per voice whatever the pitch, and the per sample work is the same
+// short arithmetic loop for every mode, laid out as structure-of-arrays so it vectorises across modes.
+class ModalResonator
+{
+public:
+    static constexpr int maxModes = 32;
+
+    // ====== SAMPLERATE =======
+    void setSamplerate (float samplerate)
+    {
+        sr = samplerate;
+        kernels = &DspKernels::get();
+    }
+
+    // ====== DAMPENING - SAME CUTOFF MAPPING AS KARPLUS STRONG =======
+    void setDampening (float damp) // Takes values between 0-1
+    {
+        float filterFreq = (damp + 0.01f)
+                           * (sr / 2)
+                           * 0.99f;
+
+        loopCoeff = std::exp (-juce::MathConstants<float>::twoPi * filterFreq / sr);
+    }
+
+    // ====== FEEDBACK - LOSS PER PERIOD OF THE FUNDAMENTAL =======
+    void setFeedback (float fb)
+    {
+        feedback = juce::jlimit (0.0f, 0.9999f, fb); // No non-linearity to catch values >= 1
+    }
+
+    // ====== PITCH - RECALCULATES ALL MODES =======
+    void setPitch (float freq)
+    {
+        const float twoPi = juce::MathConstants<float>::twoPi;
+
+        for (int m = 0; m < maxModes; ++m)
+        {
+            const float k = (float) (m + 1);
+            const float modeFreq = k * freq * std::sqrt (1.0f + inharmonicity * k * k); // Slightly stiff string
+
+            if (modeFreq >= sr * 0.45f)
+            {
+                coeffRe[m] = coeffIm[m] = gain[m] = 0.0f; // Above Nyquist - silent lane
+                continue;
+            }
+
+            // Loss per round trip is the feedback times the loop filter's magnitude at this mode, like in the delay line model
+            const float w = twoPi * modeFreq / sr;
+            const float loopGain = (1.0f - loopCoeff) / std::sqrt (1.0f - 2.0f * loopCoeff * std::cos (w) + loopCoeff * loopCoeff);
+            const float roundTrip = feedback * loopGain;
+            const float radius = std::pow (roundTrip, freq / sr); // Per sample
+
+            coeffRe[m] = radius * std::cos (w);
+            coeffIm[m] = radius * std::sin (w);
+            gain[m] = (1.0f - radius) / (1.0f - roundTrip); // Same peak gain as the comb filter at this harmonic
+        }
+    }
+
+    void reset()
+    {
+        for (int m = 0; m < maxModes; ++m)
+            stateRe[m] = stateIm[m] = 0.0f;
+    }
+
+    // ====== PROCESS =======
+    float process (float& inSamp)
+    {
+        // Fixed trip count across SoA lanes - dispatched to the widest instruction set available
+        float out = kernels->modalStep (coeffRe, coeffIm, stateRe, stateIm, gain, inSamp, maxModes);
+
+        return juce::jlimit (-1.0f, 1.0f, out); // Output safety clamp - the bank has no loop to saturate, this only guards the mix
+    }
+
+private:
+    alignas (32) float coeffRe[maxModes] {};
+    alignas (32) float coeffIm[maxModes] {};
+    alignas (32) float stateRe[maxModes] {};
+    alignas (32) float stateIm[maxModes] {};
+    alignas (32) float gain[maxModes] {};
+
+    float loopCoeff = 0.5f;
+    float feedback = 0.9f;
+    float sr = 44100.0f;
+    const DspKernels* kernels = &DspKernels::get();
+
+    static constexpr float inharmonicity = 0.0001f;
+};
@@ -37,10 +37,8 @@ public:
     
 private:
     // ====== COEFFICIENTS =======
-    float coeffA1;
-    float coeffA2;
-    
-    Delay sampleDelay;
+    float coeffA1 = 0.0f;
+    float coeffA2 = 0.0f;
     
     float oldy = 0.0f;
     float oldx = 0.0f;
@@ -1,5 +1,6 @@
 #include <math.h>
 #include <cmath>
+#include "DspKernels.h"
 
 #ifndef Oscillators_h
 #define Oscillators_h
@@ -42,6 +43,11 @@ public:
         phaseDelta = frequency / sampleRate;
     }
     
+    void setPhase (float newPhase) // 0-1, the next sample is one step further
+    {
+        phase = newPhase;
+    }
+    
 private:
     float frequency;
     float sampleRate;
@@ -59,6 +65,12 @@ public:
         waveType = choice;
     }
     
+    void setNoiseSeed (uint32_t seed)
+    {
+        noiseState = seed;
+        noisePos = noiseBlockSize; // Start a fresh block from the new seed
+    }
+    
     float output (float p) override
     {
         // SINE
@@ -86,8 +98,12 @@ public:
         
         // WHITE NOISE
         if (waveType == 4) {
-            float noise = (random.nextFloat() - 0.5) * 2.0f;
-            return noise;
+            if (noisePos == noiseBlockSize) // Refill a block at a time with the vectorised generator
+            {
+                DspKernels::get().whiteNoise (noiseBlock, noiseState, noiseBlockSize);
+                noisePos = 0;
+            }
+            return noiseBlock[noisePos++];
         }
         
         // BREAK PROGRAM OTHERWISE
@@ -100,7 +116,10 @@ public:
     
     
 private:
-    juce::Random random;
+    static constexpr int noiseBlockSize = 64;
+    float noiseBlock[noiseBlockSize];
+    int noisePos = noiseBlockSize;
+    uint32_t noiseState = (uint32_t) juce::Random().nextInt(); // Different stream per voice - own Random, voices are built on export threads too
     
     int waveType;
 };
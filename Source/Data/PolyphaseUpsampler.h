@@ -0,0 +1,145 @@
+#pragma once
+#include <cmath>
+
+// ====== POLYPHASE FIR UPSAMPLER =======
+// Raises the summed mix of the engine by an integer factor to the host rate. The Kaiser windowed sinc is split
+// into one short filter per output phase, so every output sample costs tapsPerPhase multiply-adds and none of
+// the inserted zeros is ever multiplied. Host blocks that are not a multiple of the factor leave up to factor - 1
+// samples over, which start the next block.
+class PolyphaseUpsampler
+{
+public:
+    static constexpr int maxFactor = 8;
+    static constexpr int tapsPerPhase = 48;
+
+    // ====== SETUP - ALLOCATES =======
+    void prepare (int newFactor, int newNumChannels)
+    {
+        factor = juce::jlimit (1, maxFactor, newFactor);
+        numChannels = newNumChannels;
+
+        history.setSize (numChannels, 2 * tapsPerPhase); // Mirrored, so the newest tapsPerPhase samples are always contiguous
+        leftover.setSize (numChannels, maxFactor);
+        designFilter();
+        reset();
+    }
+
+    void reset()
+    {
+        history.clear();
+        leftover.clear();
+        historyPos = 0;
+        numBuffered = 0;
+    }
+
+    // ====== TIMING =======
+    int getLatencyInSamples() const { return factor > 1 ? factor * tapsPerPhase / 2 - 1 : 0; } // Group delay at the host rate
+    int getNumBuffered() const { return numBuffered; } // Host samples already computed for the next block
+
+    int getNumInputSamplesNeeded (int numOutputSamples) const
+    {
+        return juce::jmax (0, (numOutputSamples - numBuffered + factor - 1) / factor);
+    }
+
+    // ====== PROCESS - input MUST HOLD getNumInputSamplesNeeded (output.getNumSamples()) SAMPLES =======
+    void process (const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output)
+    {
+        const int numInput = input.getNumSamples();
+        const int numOutput = output.getNumSamples();
+        const int channels = juce::jmin (numChannels, input.getNumChannels(), output.getNumChannels());
+        int pos = historyPos;
+
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            const float* in = input.getReadPointer (ch);
+            float* out = output.getWritePointer (ch);
+            float* hist = history.getWritePointer (ch);
+            float* left = leftover.getWritePointer (ch);
+
+            // The output is the leftover followed by the new samples - whatever does not fit becomes the next leftover.
+            // Leftover slots are always read before they are written again.
+            int emitted = 0;
+            auto emit = [&] (float value)
+            {
+                if (emitted < numOutput)
+                    out[emitted] = value;
+                else
+                    left[emitted - numOutput] = value;
+
+                ++emitted;
+            };
+
+            for (int i = 0; i < numBuffered; ++i)
+                emit (left[i]);
+
+            pos = historyPos;
+
+            for (int i = 0; i < numInput; ++i)
+            {
+                pos = pos == 0 ? tapsPerPhase - 1 : pos - 1; // Newest sample first
+                hist[pos] = hist[pos + tapsPerPhase] = in[i];
+                const float* window = hist + pos;
+
+                for (int p = 0; p < factor; ++p)
+                {
+                    const float* coeffs = phases[p];
+                    float sum = 0.0f;
+
+                    for (int k = 0; k < tapsPerPhase; ++k) // Fixed trip count - vectorised by the compiler
+                        sum += coeffs[k] * window[k];
+
+                    emit (sum);
+                }
+            }
+        }
+
+        historyPos = pos;
+        numBuffered = numBuffered + numInput * factor - numOutput;
+        jassert (numBuffered >= 0 && numBuffered < juce::jmax (1, factor));
+    }
+
+private:
+    // ====== KAISER WINDOWED SINC, SPLIT INTO PHASES =======
+    void designFilter()
+    {
+        const int numTaps = factor * tapsPerPhase - 1; // Odd length - whole sample group delay
+        const double centre = (numTaps - 1) * 0.5;
+        const double cutoff = 0.45 / factor; // Cycles per host sample - transition band ends near the engine's Nyquist
+        const double beta = 8.0; // About 80dB stopband
+
+        for (int p = 0; p < maxFactor; ++p)
+            for (int k = 0; k < tapsPerPhase; ++k)
+                phases[p][k] = 0.0f;
+
+        for (int n = 0; n < numTaps; ++n)
+        {
+            const double x = n - centre;
+            const double sinc = x == 0.0 ? 1.0 : std::sin (juce::MathConstants<double>::pi * 2.0 * cutoff * x) / (juce::MathConstants<double>::pi * 2.0 * cutoff * x);
+            const double ratio = x / centre;
+            const double window = besselI0 (beta * std::sqrt (juce::jmax (0.0, 1.0 - ratio * ratio))) / besselI0 (beta);
+
+            phases[n % factor][n / factor] = (float) (2.0 * cutoff * sinc * window * factor); // Gain of factor makes up for the zeros
+        }
+    }
+
+    static double besselI0 (double x)
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x * 0.5 / k) * (x * 0.5 / k);
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    int factor = 1;
+    int numChannels = 0;
+
+    alignas (32) float phases[maxFactor][tapsPerPhase] {};
+    juce::AudioBuffer<float> history, leftover;
+    int historyPos = 0;
+    int numBuffered = 0;
+};
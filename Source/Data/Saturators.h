@@ -0,0 +1,281 @@
+#pragma once
+#include "DspKernels.h"
+#include <cmath>
+
+// ====== LOOP SATURATION =======
+enum class SaturationShape
+{
+    clip, // Hard clip at +-1 - the original sound
+    fold, // Triangle fold, keeps reflecting between +-1
+    tanh  // Soft clip
+};
+
+// ====== ANTIDERIVATIVE ANTI-ALIASING =======
+// A hard nonlinearity inside the loop aliases every time the signal crosses the limit. ADAA replaces f(x) by the
+// mean of f between consecutive inputs, taken from its antiderivative: (F1(x) - F1(x1)) / (x - x1). The
+// second order version does the same once more with F2 and suppresses further aliasing. Both cost a fraction
+// of oversampling the loop, in exchange for a short lowpass and 0.5 or 1 sample of delay, which the strings
+// take off their loop length.
+enum class Antialiasing
+{
+    off,
+    firstOrder,
+    secondOrder
+};
+
+class Saturator
+{
+public:
+    // ====== SETTER FUNCTIONS =======
+    void setShape (SaturationShape newShape)
+    {
+        shape = newShape;
+    }
+
+    void setAntialiasing (Antialiasing newAntialiasing)
+    {
+        if (newAntialiasing != antialiasing)
+            reset();
+
+        antialiasing = newAntialiasing;
+    }
+
+    SaturationShape getShape() const
+    {
+        return shape;
+    }
+
+    Antialiasing getAntialiasing() const
+    {
+        return antialiasing;
+    }
+
+    void reset()
+    {
+        x1 = x2 = 0.0;
+    }
+
+    float getDelayInSamples() const // Group delay at low frequencies - taken off the loop length
+    {
+        return getDelayInSamples (antialiasing);
+    }
+
+    static float getDelayInSamples (Antialiasing a)
+    {
+        return a == Antialiasing::secondOrder ? 1.0f : (a == Antialiasing::firstOrder ? 0.5f : 0.0f);
+    }
+
+    // ====== PROCESS =======
+    float process (float x) // A span of one - the same paths as processBlock()
+    {
+        processSpan (&x, 1);
+        return x;
+    }
+
+    // ====== PROCESS A SPAN - DspKernels::saturate, THE BEST VARIANT FOR THIS CPU =======
+    void processBlock (float* data, int numSamples)
+    {
+        DspKernels::get().saturate (*this, data, numSamples);
+    }
+
+    // ====== SPAN BODY - INLINED INTO EVERY KERNEL VARIANT =======
+    // Same result as process() on every sample. ADAA only looks at past inputs, so the span is walked backwards
+    // and overwritten in place: the switches are hoisted and the clip and fold loops vectorise - GCC needs the
+    // AVX-512 masks for the ADAA branches.
+    void processSpan (float* data, int numSamples)
+    {
+        switch (shape)
+        {
+            case SaturationShape::fold: processSpan<SaturationShape::fold> (data, numSamples); break;
+            case SaturationShape::tanh: processSpan<SaturationShape::tanh> (data, numSamples); break;
+            case SaturationShape::clip: processSpan<SaturationShape::clip> (data, numSamples); break;
+        }
+    }
+
+    // ====== NAIVE SHAPES AND THEIR ANTIDERIVATIVES =======
+    static double apply (SaturationShape s, double x)
+    {
+        switch (s)
+        {
+            case SaturationShape::fold:
+            {
+                const double t = wrapFold (x);
+                return t < 2.0 ? t - 1.0 : 3.0 - t;
+            }
+            case SaturationShape::tanh: return std::tanh (x);
+            case SaturationShape::clip: break;
+        }
+
+        return x > 1.0 ? 1.0 : (x < -1.0 ? -1.0 : x);
+    }
+
+    static double antiderivative1 (SaturationShape s, double x)
+    {
+        switch (s)
+        {
+            case SaturationShape::fold:
+            {
+                const double t = wrapFold (x);
+                return t < 2.0 ? 0.5 * (t - 1.0) * (t - 1.0) : 1.0 - 0.5 * (3.0 - t) * (3.0 - t);
+            }
+            case SaturationShape::tanh: return logCosh (x);
+            case SaturationShape::clip: break;
+        }
+
+        const double a = std::abs (x);
+        return a <= 1.0 ? 0.5 * x * x : a - 0.5;
+    }
+
+    static double antiderivative2 (SaturationShape s, double x)
+    {
+        switch (s)
+        {
+            case SaturationShape::fold:
+            {
+                // Grows by the mean of F1 (0.5 per unit), plus a periodic part
+                const double t = wrapFold (x);
+                const double periodic = t < 2.0 ? (t - 1.0) * (t - 1.0) * (t - 1.0) / 6.0 - 0.5 * t + 0.5
+                                                : (3.0 - t) * (3.0 - t) * (3.0 - t) / 6.0 + 0.5 * t - 1.5;
+                return 0.5 * x + periodic;
+            }
+            case SaturationShape::tanh:
+            {
+                // Odd function: x^2/2 - x ln2 + (Li2 (-e^-2x) + pi^2/12) / 2 for x >= 0
+                const double a = std::abs (x);
+                const double value = 0.5 * a * a - a * std::log (2.0)
+                                     + 0.5 * (dilogarithm (-std::exp (-2.0 * a)) + juce::MathConstants<double>::pi * juce::MathConstants<double>::pi / 12.0);
+                return x < 0.0 ? -value : value;
+            }
+            case SaturationShape::clip: break;
+        }
+
+        if (x > 1.0)
+            return 0.5 * x * x - 0.5 * x + 1.0 / 6.0;
+        if (x < -1.0)
+            return -0.5 * x * x - 0.5 * x - 1.0 / 6.0;
+        return x * x * x / 6.0;
+    }
+
+    // ====== ONE SAMPLE WITH THE SETTINGS KNOWN - StringLoop HOISTS THE SWITCHES OUT OF ITS LOOP =======
+    template <SaturationShape s, Antialiasing a>
+    float processSample (float input)
+    {
+        if (a == Antialiasing::off)
+            return (float) apply (s, input);
+
+        const double x = input;
+        const double y = a == Antialiasing::firstOrder ? firstOrder<s> (x, x1) : secondOrder<s> (x, x1, x2);
+
+        x2 = x1;
+        x1 = x;
+        return (float) y;
+    }
+
+    // ====== ONE ADAA STEP FROM THE INPUT HISTORY - SHARED BY THE SPANS AND THE UNISON LANES =======
+    template <SaturationShape s>
+    static double firstOrder (double x, double x1)
+    {
+        const double difference = x - x1;
+        return std::abs (difference) < tolerance ? apply (s, 0.5 * (x + x1)) // Ill-conditioned - the mean is f at the midpoint
+                                                 : (antiderivative1 (s, x) - antiderivative1 (s, x1)) / difference;
+    }
+
+    template <SaturationShape s>
+    static double secondOrder (double x, double x1, double x2)
+    {
+        if (std::abs (x - x2) < tolerance)
+        {
+            // Outer points coincide - first order ADAA between their midpoint and x1
+            const double midpoint = 0.5 * (x + x2);
+            const double delta = midpoint - x1;
+
+            return std::abs (delta) < tolerance ? apply (s, 0.5 * (midpoint + x1))
+                                                : 2.0 / delta * (antiderivative1 (s, midpoint) + (antiderivative2 (s, x1) - antiderivative2 (s, midpoint)) / delta);
+        }
+
+        return 2.0 / (x - x2) * (dividedDifference<s> (x, x1) - dividedDifference<s> (x1, x2));
+    }
+
+private:
+    template <SaturationShape s>
+    void processSpan (float* data, int numSamples)
+    {
+        if (numSamples <= 0)
+            return;
+
+        if (antialiasing == Antialiasing::off)
+        {
+            for (int i = 0; i < numSamples; ++i)
+                data[i] = (float) apply (s, data[i]);
+
+            return;
+        }
+
+        // The newest inputs become the history before the span is overwritten
+        const double last = data[numSamples - 1];
+        const double beforeLast = numSamples > 1 ? (double) data[numSamples - 2] : x1;
+
+        if (antialiasing == Antialiasing::firstOrder)
+        {
+            for (int i = numSamples - 1; i > 0; --i)
+                data[i] = (float) firstOrder<s> (data[i], data[i - 1]);
+
+            data[0] = (float) firstOrder<s> (data[0], x1);
+        }
+        else
+        {
+            for (int i = numSamples - 1; i > 1; --i)
+                data[i] = (float) secondOrder<s> (data[i], data[i - 1], data[i - 2]);
+
+            if (numSamples > 1)
+                data[1] = (float) secondOrder<s> (data[1], data[0], x1);
+
+            data[0] = (float) secondOrder<s> (data[0], x1, x2);
+        }
+
+        x2 = beforeLast;
+        x1 = last;
+    }
+
+    template <SaturationShape s>
+    static double dividedDifference (double a, double b)
+    {
+        const double difference = a - b;
+        return std::abs (difference) < tolerance ? antiderivative1 (s, 0.5 * (a + b))
+                                                 : (antiderivative2 (s, a) - antiderivative2 (s, b)) / difference;
+    }
+
+    // ====== HELPERS =======
+    static double wrapFold (double x) // Position in the fold's period of 4, with 1 at x = 0 - floor rather than fmod, so it vectorises
+    {
+        const double t = x + 1.0;
+        return t - 4.0 * std::floor (t * 0.25);
+    }
+
+    static double logCosh (double x) // Does not overflow for large x
+    {
+        const double a = std::abs (x);
+        return a + std::log1p (std::exp (-2.0 * a)) - std::log (2.0);
+    }
+
+    static double dilogarithm (double z) // For -1 <= z <= 0 - Landen's identity keeps the series argument below 0.5
+    {
+        const double u = z / (z - 1.0);
+        double sum = 0.0, power = u;
+
+        for (int k = 1; k <= 40 && std::abs (power) > 1.0e-17; ++k)
+        {
+            sum += power / (double) (k * k);
+            power *= u;
+        }
+
+        const double l = std::log1p (-z);
+        return -sum - 0.5 * l * l;
+    }
+
+    SaturationShape shape = SaturationShape::clip;
+    Antialiasing antialiasing = Antialiasing::off;
+    double x1 = 0.0, x2 = 0.0; // Previous inputs
+
+    static constexpr double tolerance = 1.0e-5;
+};
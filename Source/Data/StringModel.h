@@ -1,8 +1,84 @@
 #pragma once
 #include "FeedbackDelay.h"
 #include "NonLinAllpass.h"
+#include "Saturators.h"
+#include "DspKernels.h"
 #include <cmath> // Used for tanh()
 
+// ====== KARPLUS STRONG LOOP BODY - ALLPASS, SATURATION AND LOWPASS, WITHOUT THE DELAY LINE =======
+// Runs through DspKernels::stringLoop for single samples and whole spans alike, so both read paths share one
+// compiled body per instruction set and stay sample-for-sample equal. One pass rather than one per stage: the
+// allpass and lowpass recursions are latency bound, and interleaved the CPU overlaps them.
+struct StringLoop
+{
+    void process (float* data, int numSamples)
+    {
+        switch (saturator.getShape()) // Hoisted out of the sample loop
+        {
+            case SaturationShape::fold: process<SaturationShape::fold> (data, numSamples); break;
+            case SaturationShape::tanh: process<SaturationShape::tanh> (data, numSamples); break;
+            case SaturationShape::clip: process<SaturationShape::clip> (data, numSamples); break;
+        }
+    }
+    
+    template <SaturationShape shape>
+    void process (float* data, int numSamples)
+    {
+        switch (saturator.getAntialiasing())
+        {
+            case Antialiasing::firstOrder:  process<shape, Antialiasing::firstOrder> (data, numSamples); break;
+            case Antialiasing::secondOrder: process<shape, Antialiasing::secondOrder> (data, numSamples); break;
+            case Antialiasing::off:         process<shape, Antialiasing::off> (data, numSamples); break;
+        }
+    }
+    
+    template <SaturationShape shape, Antialiasing antialiasing>
+    void process (float* data, int numSamples)
+    {
+        // Local copies - data could alias the members, which would keep both recursions in memory
+        NonLinearAllpass spanAllpass = allpass;
+        const float c[5] = { coeffs[0], coeffs[1], coeffs[2], coeffs[3], coeffs[4] };
+        float s1 = v1, s2 = v2;
+        
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float currentSample = spanAllpass.process (data[i]);
+            currentSample = saturator.processSample<shape, antialiasing> (currentSample); // Hard clip unless the patch picks another shape
+            
+            data[i] = dampen (c, s1, s2, currentSample);
+        }
+        
+        allpass = spanAllpass;
+        v1 = s1;
+        v2 = s2;
+    }
+    
+    // ====== LOOP LOWPASS - TRANSPOSED DIRECT FORM II, SNAPPED TO ZERO LIKE juce::IIRFilter =======
+    static float dampenStep (const float* c, float& v1, float& v2, float in)
+    {
+        float out = c[0] * in + v1;
+        JUCE_SNAP_TO_ZERO (out);
+        v1 = c[1] * in - c[3] * out + v2;
+        v2 = c[2] * in - c[4] * out;
+        return out;
+    }
+    
+    static float dampen (const float* c, float& v1, float& v2, float in)
+    {
+        const float out = dampenStep (c, v1, v2, in);
+        dampenStep (c, v1, v2, out); // The second step only moves the filter state - part of the sound
+        
+        JUCE_SNAP_TO_ZERO (v1); // Flush the state so a decaying tail never runs into denormals
+        JUCE_SNAP_TO_ZERO (v2);
+        return out;
+    }
+    
+    NonLinearAllpass allpass;
+    Saturator saturator;
+    float coeffs[5] {}; // b0, b1, b2, a1, a2 like juce::IIRCoefficients
+    float v1 = 0.0f, v2 = 0.0f;
+};
+
 // ====== KARPLUS STRONG =======
 class KarplusStrong : public Delay
 {
@@ -20,29 +96,113 @@ public:
         * (sr / 2)  // Multiplies dampening by Nyquist Frequency
                             * 0.99f; // Get practical value
 
-        dampen.setCoefficients (juce::IIRCoefficients::makeLowPass(sr, filterFreq, 1.0f));
-        dcBlock.setCoefficients (juce::IIRCoefficients::makeHighPass(sr, filterFreq));
+        const auto coefficients = juce::IIRCoefficients::makeLowPass (sr, filterFreq, 1.0f);
+        
+        for (int c = 0; c < 5; ++c)
+            loop.coeffs[c] = coefficients.coefficients[c];
+    }
+    
+    // ====== LOOP SATURATION =======
+    void setSaturation (SaturationShape shape, Antialiasing antialiasing)
+    {
+        loop.saturator.setShape (shape);
+        loop.saturator.setAntialiasing (antialiasing);
+    }
+    
+    void setRandomSeed (juce::int64 seed)
+    {
+        random.setSeed (seed);
     }
     
     // ====== PITCH WITH INSTABILITY =======
     void setPitch (float freq)
     {
         float delayFreq = sr / freq; // Get delaytime from frequency
-        setDelayTimeInSamples (delayFreq); // Set delaytime in original function
+        setDelayTimeInSamples (delayFreq - loop.saturator.getDelayInSamples()); // Anti-aliasing delay is part of the loop
         
         float noise = (random.nextFloat() - 0.5) * 2;
-        allpass.setCoefficients (noise, noise);
+        loop.allpass.setCoefficients (noise, noise);
+        
+        resetFractionalRead();
     }
     
+    float getDelayTimeInSamples() const { return (float) delayTimeInSamples; } // Unmodulated loop length
+    
     // ====== PROCESS =======
     float process (float& inSamp) override
     {
         float outVal = readVal();
+        return feedbackLoop (inSamp, outVal);
+    }
+    
+    // ====== PROCESS WITH A MODULATED LOOP LENGTH - PITCH BEND AND VIBRATO =======
+    // delays holds the loop length of every sample. The interpolation mode is picked once per call.
+    void processModulated (const float* input, float* output, const float* delays, int numSamples)
+    {
+        switch (interpolation)
+        {
+            case DelayInterpolation::linear:  processModulated<DelayInterpolation::linear> (input, output, delays, numSamples); break;
+            case DelayInterpolation::allpass: processModulated<DelayInterpolation::allpass> (input, output, delays, numSamples); break;
+            default:                          processModulated<DelayInterpolation::lagrange3> (input, output, delays, numSamples); break;
+        }
+    }
+    
+    template <DelayInterpolation mode>
+    void processModulated (const float* input, float* output, const float* delays, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float outVal = readFractional<mode> (delays[i]);
+            readPos = (readPos + 1) % size; // Integer read position stays in step for the unmodulated path
+            float inSamp = input[i];
+            output[i] = feedbackLoop (inSamp, outVal);
+        }
+    }
+    
+    // ====== TIME-BLOCKED PROCESS - THE LOOP CANNOT HEAR ITSELF SOONER THAN ONE PERIOD =======
+    // Every sample read within one loop length was written before the span started, so the read, the loop body
+    // and the write each run over a whole span: storage conversion and feedback mix stream through contiguous
+    // memory, and the loop body runs through DspKernels::stringLoop. Same output as process().
+    void processBlock (const float* input, float* output, int numSamples)
+    {
+        const int maxSpan = juce::jmin (delayTimeInSamples, spanSize);
         
-        float currentSample = allpass.process (outVal);
+        if (maxSpan < minSpan) // Very short loops - scalar fallback
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                float inSamp = input[i];
+                output[i] = process (inSamp);
+            }
+            
+            return;
+        }
         
-        currentSample = clip (currentSample);
-        currentSample = loPass (currentSample); // process through IRR Filter
+        while (numSamples > 0)
+        {
+            const int span = juce::jmin (numSamples, maxSpan);
+            
+            readBlock (output, span);
+            
+            kernels->stringLoop (loop, output, span);
+            
+            const float fb = feedback;
+            for (int i = 0; i < span; ++i) // Feedback scales output back into input
+                loopSpan[i] = input[i] + fb * output[i];
+            
+            writeBlock (loopSpan, span);
+            
+            input += span;
+            output += span;
+            numSamples -= span;
+        }
+    }
+    
+    // ====== LOOP BODY SHARED BY BOTH READ PATHS =======
+    float feedbackLoop (float& inSamp, float outVal)
+    {
+        float currentSample = outVal;
+        kernels->stringLoop (loop, &currentSample, 1); // A span of one - the same body as processBlock()
         
         writeVal (inSamp + feedback * currentSample); // Feedback scales output back into input
         float floor (currentSample); // Calculate interpolation
@@ -76,19 +236,14 @@ public:
         return inSamp;
     }
     
-    float loPass (float& inSamp)
-    {
-        float currentSample = dampen.processSingleSampleRaw (inSamp); // process through IRR Filter
-        dampen.processSingleSampleRaw (currentSample);
-        dcBlock.processSingleSampleRaw (currentSample);
-        
-        return currentSample;
-    }
-
 private:
-    juce::IIRFilter dampen, dcBlock;
+    // ====== SPAN SCRATCH =======
+    static constexpr int spanSize = 256;
+    static constexpr int minSpan = 8; // Shorter loops are not worth blocking
+    float loopSpan[spanSize];
+    
     juce::Random random;
     
-    // ====== ALLPASS =======
-    NonLinearAllpass allpass;
+    // ====== ALLPASS, SATURATION AND LOWPASS - THROUGH Delay::kernels =======
+    StringLoop loop;
 };
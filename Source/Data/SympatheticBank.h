@@ -0,0 +1,193 @@
+#pragma once
+#include "DspKernels.h"
+
+// ====== SYMPATHETIC STRING BANK =======
+// A fixed set of undamped-ish Karplus Strong strings, shared by the whole instrument and driven by the
+// summed voice output. The strings are laid out as structure-of-arrays so the loop filter, gain and mix
+// arithmetic runs across all strings at once - the cost depends on the string count, never on the note count.
+// Only that arithmetic is SIMD: every string has its own length, so the delay taps are gathered and scattered one by one.
+class SympatheticBank
+{
+public:
+    static constexpr int maxStrings = 48;
+    static constexpr int minStrings = 12;
+
+    enum Scale
+    {
+        chromatic = 0,
+        major,
+        minor,
+        pentatonic
+    };
+
+    // ====== SETUP - ALLOCATES =======
+    void prepare (double sampleRate)
+    {
+        sr = (float) sampleRate;
+        dampening = -1.0f; // The cutoff depends on the rate
+
+        stride = (int) std::ceil (sr / lowestFreq) + 1; // Longest string that can be tuned
+        buffer.calloc ((size_t) (stride * maxStrings));
+
+        for (int s = 0; s < maxStrings; ++s)
+        {
+            pos[s] = 0;
+            lpState[s] = 0.0f;
+        }
+
+        tuningChanged = true;
+        update();
+    }
+
+    void reset()
+    {
+        juce::FloatVectorOperations::clear (buffer, stride * maxStrings);
+
+        for (int s = 0; s < maxStrings; ++s)
+            lpState[s] = 0.0f;
+    }
+
+    // ====== SETTER FUNCTIONS - CHEAP, RECALCULATION HAPPENS ON CHANGE ONLY =======
+    void setTuning (int newRootNote, int newScale, int newNumStrings)
+    {
+        newNumStrings = juce::jlimit (minStrings, maxStrings, newNumStrings);
+
+        if (newRootNote != rootNote || newScale != scale || newNumStrings != numStrings)
+        {
+            rootNote = newRootNote;
+            scale = newScale;
+            numStrings = newNumStrings;
+            tuningChanged = true;
+        }
+    }
+
+    void setDecay (float newDecaySeconds) // Time to -60dB
+    {
+        if (newDecaySeconds != decaySeconds)
+        {
+            decaySeconds = newDecaySeconds;
+            tuningChanged = true;
+        }
+    }
+
+    void setDampening (float damp) // Takes values between 0-1 - brighter as it goes up, like the voices
+    {
+        if (damp == dampening)
+            return;
+
+        dampening = damp;
+
+        // Same cutoff as KarplusStrong::setDampening, as a one pole coefficient - 1 is fully open
+        const float cutoff = (damp + 0.01f) * (sr / 2.0f) * 0.99f;
+        dampCoeff = 1.0f - std::exp (-juce::MathConstants<float>::twoPi * cutoff / sr);
+    }
+
+    // ====== PROCESS =======
+    // Sums the buffer to mono as excitation and adds the resonance back onto every channel
+    void process (juce::AudioBuffer<float>& audio, float mix)
+    {
+        if (mix <= 0.0f)
+            return;
+
+        update();
+
+        const int numChannels = audio.getNumChannels();
+        const int numSamples = audio.getNumSamples();
+        const float inputScale = inputGain / (float) numChannels;
+
+        // Lanes are padded to a multiple of 8 - padded lanes have zero gain and stay silent
+        const int lanes = (numStrings + 7) & ~7;
+        const DspKernels& kernels = DspKernels::get();
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float excitation = 0.0f;
+            for (int ch = 0; ch < numChannels; ++ch)
+                excitation += audio.getSample (ch, i);
+            excitation *= inputScale;
+
+            // ====== GATHER =======
+            for (int s = 0; s < lanes; ++s)
+                tap[s] = buffer[s * stride + pos[s]];
+
+            // ====== LOOP FILTER, GAIN AND SUM - ONE SIMD BATCH ACROSS STRINGS =======
+            const float sum = kernels.loopFilterLanes (tap, lpState, gain, dampCoeff, lanes);
+
+            // ====== SCATTER =======
+            for (int s = 0; s < lanes; ++s)
+            {
+                buffer[s * stride + pos[s]] = excitation * active[s] + tap[s];
+                pos[s] = pos[s] + 1 < length[s] ? pos[s] + 1 : 0;
+            }
+
+            const float out = sum * mix * outputGain;
+            for (int ch = 0; ch < numChannels; ++ch)
+                audio.addSample (ch, i, out);
+        }
+    }
+
+private:
+    // ====== TUNING =======
+    void update()
+    {
+        if (! tuningChanged)
+            return;
+
+        static const int scaleSteps[4][12] = { { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+                                               { 0, 2, 4, 5, 7, 9, 11 },
+                                               { 0, 2, 3, 5, 7, 8, 10 },
+                                               { 0, 2, 4, 7, 9 } };
+        static const int scaleLength[4] = { 12, 7, 7, 5 };
+
+        const int scaleIndex = juce::jlimit (0, 3, scale);
+        const int steps = scaleLength[scaleIndex];
+
+        for (int s = 0; s < maxStrings; ++s)
+        {
+            const int note = rootNote + 12 * (s / steps) + scaleSteps[scaleIndex][s % steps];
+            const float freq = (float) juce::MidiMessage::getMidiNoteInHertz (note);
+
+            // Strings past MIDI 127 or Nyquist stay silent - clamped to a 2 sample loop they would ring DC or Nyquist
+            if (s < numStrings && note <= 127 && freq < sr * 0.5f)
+            {
+                length[s] = juce::jlimit (2, stride, (int) std::round (sr / freq));
+                gain[s] = std::pow (0.001f, 1.0f / (decaySeconds * freq)); // Per round trip, reaches -60dB after decaySeconds
+                active[s] = 1.0f;
+            }
+            else
+            {
+                length[s] = 2;
+                gain[s] = 0.0f;
+                active[s] = 0.0f;
+            }
+
+            pos[s] = pos[s] % length[s];
+        }
+
+        tuningChanged = false;
+    }
+
+    juce::HeapBlock<float> buffer; // All strings in one block - string s starts at s * stride
+    int stride = 0;
+
+    // ====== STRUCTURE OF ARRAYS - ONE LANE PER STRING =======
+    alignas (32) float tap[maxStrings] {};
+    alignas (32) float lpState[maxStrings] {};
+    alignas (32) float gain[maxStrings] {};
+    alignas (32) float active[maxStrings] {};
+    int pos[maxStrings] {};
+    int length[maxStrings] {};
+
+    int rootNote = 36;
+    int scale = chromatic;
+    int numStrings = 24;
+    float decaySeconds = 3.0f;
+    float dampening = -1.0f;
+    float dampCoeff = 0.5f;
+    bool tuningChanged = true;
+
+    float sr = 44100.0f;
+    static constexpr float lowestFreq = 30.0f; // Lowest root is MIDI note 24 at ~32.7Hz
+    static constexpr float inputGain = 0.05f;
+    static constexpr float outputGain = 0.5f;
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include "DspKernels.h"
+#include "FeedbackDelay.h"
+#include "Saturators.h"
+#include <cmath>
+
+// ====== UNISON STRING STACK =======
+// Up to eight detuned Karplus Strong strings for one note. Every string has its own delay line and loop state,
+// laid out as structure-of-arrays so the loop body runs across all strings at once - the kernel is always eight
+// lanes wide, so a stack of four costs little more than one scalar string. All strings share one write position
+// and read behind it with a linear fractional tap, which is what lets the detune go below a whole sample.
+class UnisonString
+{
+public:
+    static constexpr int maxStrings = StringLanes::maxLanes;
+
+    // ====== DELAY LINE STORAGE - CALL BEFORE prepare(), LIKE Delay::setStorage =======
+    void setStorage (DelayStorage newStorage)
+    {
+        storage = newStorage;
+    }
+
+    // ====== SETUP - ALLOCATES =======
+    // Only the lines of numLanes strings are allocated - setStrings() never uses more, and 0 frees them. They are
+    // sized for the fastest rate the engine will run at, so oversampled renders keep the low notes.
+    void prepare (float sampleRate, float maxSampleRate, int numLanes)
+    {
+        sr = sampleRate;
+        numAllocated = juce::jlimit (0, maxStrings, numLanes);
+        numStrings = juce::jmin (numStrings, numAllocated);
+        stride = (int) std::ceil (juce::jmax (sampleRate, maxSampleRate) / lowestFreq) + 2;
+
+        // Only the buffer of the chosen format is allocated - the other one is released
+        if (storage == DelayStorage::int16)
+        {
+            compactBuffer.calloc ((size_t) (stride * numAllocated));
+            buffer.free();
+        }
+        else
+        {
+            buffer.calloc ((size_t) (stride * numAllocated));
+            compactBuffer.free();
+        }
+
+        // Lanes dropped by a smaller allocation have no line to feed back through - they must not keep ringing
+        for (auto* state : { lanes.tap, lanes.allpassX, lanes.allpassY, lanes.v1, lanes.v2, lanes.active, lanes.panLeft, lanes.panRight })
+            std::fill (state, state + maxStrings, 0.0f);
+
+        std::fill (std::begin (lanes.saturatorX1), std::end (lanes.saturatorX1), 0.0);
+        std::fill (std::begin (lanes.saturatorX2), std::end (lanes.saturatorX2), 0.0);
+        writePos = 0;
+        kernels = &DspKernels::get();
+    }
+
+    void setSamplerate (float sampleRate) // Rate changes without reallocation - delays are clamped to the buffer
+    {
+        sr = sampleRate;
+    }
+
+    // ====== NOTE SETUP =======
+    // detune is the spread in cents between the outer strings, spread the stereo width 0-1
+    void setStrings (int newNumStrings, float detuneCents, float spread)
+    {
+        numStrings = juce::jmin (juce::jlimit (1, maxStrings, newNumStrings), numAllocated);
+        const float normalise = std::sqrt (2.0f / (float) juce::jmax (1, numStrings)); // Equal power pan, centre at unity
+
+        for (int s = 0; s < maxStrings; ++s)
+        {
+            const bool used = s < numStrings;
+            const float position = numStrings > 1 ? 2.0f * (float) s / (float) (numStrings - 1) - 1.0f : 0.0f; // -1 to 1
+            const float angle = (position * spread + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+
+            ratio[s] = std::exp2 (position * detuneCents * 0.5f / 1200.0f);
+            lanes.active[s] = used ? 1.0f : 0.0f;
+            lanes.panLeft[s] = used ? std::cos (angle) * normalise : 0.0f;
+            lanes.panRight[s] = used ? std::sin (angle) * normalise : 0.0f;
+
+            // Instability - every string gets its own allpass coefficients, like KarplusStrong::setPitch
+            const float noise = (random.nextFloat() - 0.5f) * 2.0f;
+            lanes.allpassA[s] = lanes.allpassB[s] = noise;
+        }
+    }
+
+    void setRandomSeed (juce::int64 seed)
+    {
+        random.setSeed (seed);
+    }
+
+    // ====== PITCH - CHEAP, CALLED ONCE PER CHUNK WHILE BENDING =======
+    void setPitch (float freq)
+    {
+        for (int s = 0; s < maxStrings; ++s)
+        {
+            const float delay = juce::jlimit (1.0f, (float) (stride - 2), sr / (freq * ratio[s]) - saturationDelay); // Anti-aliasing delay is part of the loop
+            whole[s] = (int) delay;
+            frac[s] = delay - (float) whole[s];
+        }
+    }
+
+    void setDampening (float damp) // Takes values between 0-1, same mapping as KarplusStrong
+    {
+        const float filterFreq = (damp + 0.01f) * (sr / 2) * 0.99f;
+        const auto coefficients = juce::IIRCoefficients::makeLowPass (sr, filterFreq, 1.0f);
+
+        for (int c = 0; c < 5; ++c)
+            lanes.coeffs[c] = coefficients.coefficients[c];
+    }
+
+    // ====== LOOP SATURATION - SAME SHAPES AND ANTI-ALIASING AS KarplusStrong, EVERY LANE AT ONCE =======
+    void setSaturation (SaturationShape shape, Antialiasing antialiasing)
+    {
+        if (antialiasing != lanes.antialiasing)
+        {
+            std::fill (std::begin (lanes.saturatorX1), std::end (lanes.saturatorX1), 0.0);
+            std::fill (std::begin (lanes.saturatorX2), std::end (lanes.saturatorX2), 0.0);
+        }
+
+        lanes.shape = shape;
+        lanes.antialiasing = antialiasing;
+        saturationDelay = Saturator::getDelayInSamples (antialiasing);
+    }
+
+    void setFeedback (float fb)
+    {
+        feedback = juce::jlimit (0.0f, 10.0f, fb); // Same protection as Delay::setFeedback
+    }
+
+    // ====== PROCESS - ONE SAMPLE OF THE WHOLE STACK =======
+    void process (float input, float& left, float& right)
+    {
+        // ====== GATHER - LANES WITHOUT A LINE STAY SILENT, THEY ARE NEVER EXCITED =======
+        for (int s = 0; s < numAllocated; ++s)
+        {
+            int i0 = writePos - whole[s];
+            if (i0 < 0)
+                i0 += stride;
+            const int i1 = i0 == 0 ? stride - 1 : i0 - 1;
+
+            const float x0 = readLine (s * stride + i0);
+            lanes.tap[s] = x0 + frac[s] * (readLine (s * stride + i1) - x0);
+        }
+
+        // ====== LOOP BODY ACROSS ALL STRINGS =======
+        kernels->stringLanes (lanes, input, feedback, left, right);
+
+        // ====== SCATTER =======
+        if (storage == DelayStorage::int16)
+        {
+            for (int s = 0; s < numAllocated; ++s)
+            {
+                ditherState[s] = ditherState[s] * 1664525u + 1013904223u; // One generator per lane, like Delay
+                const float dither = (float) (ditherState[s] >> 8) * (1.0f / 16777216.0f) - 0.5f; // Rectangular, +-0.5 LSB
+                compactBuffer[s * stride + writePos] = Delay::toCompact (lanes.tap[s], dither);
+            }
+        }
+        else
+        {
+            for (int s = 0; s < numAllocated; ++s)
+                buffer[s * stride + writePos] = lanes.tap[s];
+        }
+
+        writePos = writePos + 1 < stride ? writePos + 1 : 0;
+    }
+
+private:
+    StringLanes lanes;
+
+    alignas (32) float ratio[maxStrings] {};
+    alignas (32) float frac[maxStrings] {};
+    int whole[maxStrings] {};
+
+    float readLine (int index) const
+    {
+        return storage == DelayStorage::int16 ? Delay::fromCompact (compactBuffer[index]) : buffer[index];
+    }
+
+    juce::HeapBlock<float> buffer; // All strings in one block - string s starts at s * stride
+    juce::HeapBlock<int16_t> compactBuffer; // The same layout in 16-bit storage
+    DelayStorage storage = DelayStorage::float32;
+    uint32_t ditherState[maxStrings] { 1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u };
+    int numAllocated = 0;
+    int stride = 0;
+    int writePos = 0;
+    int numStrings = 1;
+
+    float feedback = 0.0f;
+    float saturationDelay = 0.0f;
+    float sr = 44100.0f;
+    const DspKernels* kernels = nullptr;
+    juce::Random random;
+
+    static constexpr float lowestFreq = 8.0f; // Just below MIDI note 0
+};
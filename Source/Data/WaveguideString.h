@@ -0,0 +1,182 @@
+#pragma once
+#include "FeedbackDelay.h"
+#include "Saturators.h"
+#include <cmath>
+
+// ====== BIDIRECTIONAL DIGITAL WAVEGUIDE =======
+// Both rails of an ideal string with inverting terminations are folded into one circular buffer of one
+// period: the upper rail is the first half of the loop, the lower rail the second. Exciting or picking up
+// at a point on the string therefore means touching the loop at two taps, one per rail - memory traffic
+// stays at one buffer per string like the Karplus Strong model.
+class WaveguideString : public Delay
+{
+public:
+    // ====== SAMPLERATE =======
+    void setSamplerate (float samplerate)
+    {
+        sr = samplerate;
+    }
+
+    // ====== DAMPENING =======
+    void setDampening (float damp) // Takes values between 0-1
+    {
+        float filterFreq = (damp + 0.01f) // Same mapping as KarplusStrong
+                           * (sr / 2)
+                           * 0.99f;
+
+        loopCoeff = std::exp (-juce::MathConstants<float>::twoPi * filterFreq / sr); // One pole lowpass
+    }
+
+    // ====== LOOP SATURATION =======
+    void setSaturation (SaturationShape shape, Antialiasing antialiasing)
+    {
+        saturator.setShape (shape);
+        saturator.setAntialiasing (antialiasing);
+    }
+
+    // ====== EXCITATION AND PICKUP POSITION =======
+    void setPositions (float pluck, float pickup) // Fraction of the string length, 0-0.5
+    {
+        pluckPos = juce::jlimit (0.01f, 0.5f, pluck);
+        pickupPos = juce::jlimit (0.01f, 0.5f, pickup);
+        updateTaps();
+    }
+
+    // ====== PITCH WITH FRACTIONAL DELAY - NOTE ON =======
+    void setPitch (float freq)
+    {
+        // Integer part goes into the buffer, the remainder into a first order Thiran allpass (best between 0.5-1.5)
+        float remaining = getLoopDelay (freq);
+        int integerDelay = juce::jmax (1, (int) std::floor (remaining - 0.5f));
+        thiranDelay = remaining - (float) integerDelay;
+
+        thiranCoeff = (1.0f - thiranDelay) / (1.0f + thiranDelay);
+
+        readPos = writePos - integerDelay;
+        while (readPos < 0)
+            readPos += size;
+
+        loopDelay = targetDelay = remaining;
+        gliding = false;
+        resetFractionalRead();
+
+        loopLength = integerDelay;
+        updateTaps();
+    }
+
+    // ====== RETUNE MID-NOTE - BENDS, VIBRATO AND DAMPENING CHANGES =======
+    // Moving readPos would click, so from the first retune on the loop reads through readFractional() and its
+    // length ramps to the new pitch over numSamples. The Thiran allpass keeps its coefficient and state - its
+    // share of the delay is taken off the read, so the hand-over is seamless.
+    void glideTo (float freq, int numSamples)
+    {
+        gliding = true;
+        targetDelay = getLoopDelay (freq);
+        glideSamples = juce::jmax (1, numSamples);
+        delayStep = (targetDelay - loopDelay) / (float) glideSamples;
+
+        loopLength = juce::jmax (2, (int) (targetDelay - thiranDelay));
+        updateTaps();
+    }
+
+    // ====== PROCESS =======
+    float process (float& inSamp) override
+    {
+        // ====== PICKUP - SUM OF BOTH RAILS AT THE PICKUP POINT =======
+        float upperRail, lowerRail;
+
+        if (gliding)
+        {
+            if (glideSamples > 0)
+                loopDelay = --glideSamples > 0 ? loopDelay + delayStep : targetDelay; // Lands on the target exactly
+
+            const float readDelay = loopDelay - thiranDelay;
+            lowerRail = tapBehind (readDelay * (1.0f - pickupPos)); // Pickup moves with the length, no steps
+            upperRail = readFractional (readDelay);
+        }
+        else
+        {
+            lowerRail = tapAt (readPos + pickupTap); // Before readVal() moves readPos on
+            upperRail = readVal();
+        }
+
+        float pickup = upperRail - lowerRail;
+
+        // ====== LOOP: FRACTIONAL ALLPASS, LOSS FILTER, SATURATION =======
+        float currentSample = thiranCoeff * upperRail + allpassX - thiranCoeff * allpassY;
+        allpassX = upperRail;
+        allpassY = currentSample;
+
+        loopState = (1.0f - loopCoeff) * currentSample + loopCoeff * loopState;
+        currentSample = saturator.process (loopState);
+
+        // ====== EXCITATION INTO BOTH RAILS AT THE PLUCK POINT =======
+        addAt (writePos - pluckTap, -inSamp); // Mirrored copy on the other rail arrives earlier
+        writeVal (inSamp + feedback * currentSample);
+
+        return pickup * 0.5f;
+    }
+
+private:
+    // Loop length in samples minus the loop filter's phase delay at the fundamental and the saturator's delay
+    float getLoopDelay (float freq) const
+    {
+        const float period = sr / freq;
+        const float w = juce::MathConstants<float>::twoPi * freq / sr;
+        const float filterDelay = std::atan2 (loopCoeff * std::sin (w), 1.0f - loopCoeff * std::cos (w)) / w;
+
+        return period - filterDelay - saturator.getDelayInSamples();
+    }
+
+    void updateTaps()
+    {
+        pluckTap = juce::jlimit (1, loopLength - 1, (int) std::round (pluckPos * (float) loopLength)); // Comb delay of the pluck point is its fraction of the period
+        pickupTap = juce::jlimit (1, loopLength - 1, (int) std::round (pickupPos * (float) loopLength));
+    }
+
+    float tapAt (int pos)
+    {
+        pos %= size;
+        return storage == DelayStorage::int16 ? fromCompact (compactBuffer[pos]) : buffer[pos];
+    }
+
+    float tapBehind (float delay) const // Linear read delay samples behind the next write
+    {
+        delay = juce::jlimit (1.0f, (float) (size - 2), delay);
+        const int whole = (int) delay;
+        const float x0 = readDelayed (whole);
+        return x0 + (delay - (float) whole) * (readDelayed (whole + 1) - x0);
+    }
+
+    void addAt (int pos, float value)
+    {
+        while (pos < 0)
+            pos += size;
+
+        if (storage == DelayStorage::int16)
+            compactBuffer[pos] = toCompact (fromCompact (compactBuffer[pos]) + value, nextDither());
+        else
+            buffer[pos] += value;
+    }
+
+    int loopLength = 100;
+
+    float pluckPos = 0.13f;
+    float pickupPos = 0.25f;
+    int pluckTap = 26;
+    int pickupTap = 50;
+
+    float loopDelay = 100.0f, targetDelay = 100.0f; // Whole loop in samples - ramps while gliding
+    float delayStep = 0.0f;
+    int glideSamples = 0;
+    bool gliding = false; // Fractional read from the first retune until the next note
+
+    float thiranDelay = 1.0f;
+    float thiranCoeff = 0.0f;
+    float allpassX = 0.0f, allpassY = 0.0f;
+
+    float loopCoeff = 0.5f;
+    float loopState = 0.0f;
+
+    Saturator saturator;
+};
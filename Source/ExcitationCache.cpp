@@ -0,0 +1,199 @@
+/*
+  ==============================================================================
+
+    ExcitationCache.cpp
+    Pre-rendered excitation bursts for the deterministic oscillator waveforms.
+
+  ==============================================================================
+*/
+
+#include "ExcitationCache.h"
+#include <tuple>
+
+//==============================================================================
+bool ExcitationCache::Patch::operator== (const Patch& other) const
+{
+    return waveType == other.waveType && attack == other.attack && decay == other.decay
+        && sustain == other.sustain && sampleRate == other.sampleRate;
+}
+
+bool ExcitationCache::Patch::operator< (const Patch& other) const
+{
+    return std::tie (waveType, attack, decay, sustain, sampleRate)
+         < std::tie (other.waveType, other.attack, other.decay, other.sustain, other.sampleRate);
+}
+
+bool ExcitationCache::Key::operator< (const Key& other) const
+{
+    if (patch == other.patch)
+        return note < other.note;
+
+    return patch < other.patch;
+}
+
+//==============================================================================
+ExcitationCache::ExcitationCache() : juce::Thread ("Excitation Cache")
+{
+}
+
+ExcitationCache::~ExcitationCache()
+{
+    stopThread (2000);
+}
+
+void ExcitationCache::prepare()
+{
+    startThread(); // Does nothing once another instance has started it
+}
+
+// ====== REQUESTS =======
+void ExcitationCache::requestPatch (const Patch& patch)
+{
+    if (! patch.isCacheable())
+        return;
+
+    {
+        const juce::SpinLock::ScopedTryLockType tryLock (lock);
+
+        if (! tryLock.isLocked())
+            return; // The caller asks again with its next change or miss
+
+        for (int i = 0; i < numPending; ++i)
+            if (pending[i] == patch)
+                return;
+
+        if (numPending == maxPending)
+            return;
+
+        pending[numPending++] = patch;
+    }
+
+    pendingChanged.store (true, std::memory_order_release);
+}
+
+int ExcitationCache::copyBurst (const Patch& patch, int midiNoteNumber, float* dest, int maxSamples)
+{
+    if (! patch.isCacheable())
+        return 0;
+
+    {
+        const juce::SpinLock::ScopedTryLockType tryLock (lock);
+
+        if (! tryLock.isLocked())
+            return 0;
+
+        auto found = index.find ({ patch, midiNoteNumber });
+
+        if (found != index.end())
+        {
+            auto entry = found->second;
+            entries.splice (entries.begin(), entries, entry); // Most recently used - no allocation
+
+            const int length = juce::jmin (entry->length, maxSamples);
+            juce::FloatVectorOperations::copy (dest, entry->samples.get(), length);
+            return length;
+        }
+    }
+
+    requestPatch (patch); // Evicted or not rendered yet
+    return 0;
+}
+
+// ====== RENDERING =======
+int ExcitationCache::getBurstLength (const Patch& patch)
+{
+    // Attack and decay - afterwards the voice continues at the sustain level live
+    const double envelopeSamples = std::ceil ((double) (patch.attack + patch.decay) * patch.sampleRate) + 1.0;
+    return (int) juce::jlimit (1.0, (double) maxBurstSamples, envelopeSamples);
+}
+
+void ExcitationCache::renderBurst (const Patch& patch, int midiNoteNumber, float* dest, int numSamples)
+{
+    const float freq = (float) juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber);
+
+    Oscillator osc;
+    osc.setSampleRate (patch.sampleRate);
+    osc.setWaveType (patch.waveType);
+    osc.setFrequency (freq);
+
+    juce::IIRFilter dcBlock;
+    dcBlock.setCoefficients (juce::IIRCoefficients::makeHighPass (patch.sampleRate, freq));
+
+    ADSRData envelope;
+    envelope.setSampleRate (patch.sampleRate);
+    envelope.updateADSR (patch.attack, patch.decay, patch.sustain, 0.1f); // Release is never reached
+    envelope.noteOn();
+
+    for (int i = 0; i < numSamples; ++i)
+        dest[i] = dcBlock.processSingleSampleRaw (osc.process()) * envelope.getNextSample();
+}
+
+void ExcitationCache::renderPatch (const Patch& patch)
+{
+    const int length = getBurstLength (patch);
+
+    for (int note = 0; note < 128 && ! threadShouldExit(); ++note)
+    {
+        {
+            const juce::SpinLock::ScopedLockType scopedLock (lock);
+
+            if (index.count ({ patch, note }) > 0)
+                continue;
+        }
+
+        // Render and allocate outside the lock, then hand the finished node over
+        std::list<Entry> node (1);
+        Entry& entry = node.front();
+        entry.key = { patch, note };
+        entry.samples.malloc ((size_t) length);
+        entry.length = length;
+        renderBurst (patch, note, entry.samples.get(), length);
+
+        std::list<Entry> evicted;
+
+        {
+            const juce::SpinLock::ScopedLockType scopedLock (lock);
+
+            entries.splice (entries.begin(), node);
+            index[entries.front().key] = entries.begin();
+            numBytes += (size_t) length * sizeof (float);
+
+            while (numBytes > maxBytes && entries.size() > 1)
+            {
+                auto last = std::prev (entries.end());
+                numBytes -= (size_t) last->length * sizeof (float);
+                index.erase (last->key);
+                evicted.splice (evicted.begin(), entries, last);
+            }
+        }
+        // evicted is freed here, outside the lock
+    }
+}
+
+// ====== BACKGROUND THREAD =======
+void ExcitationCache::run()
+{
+    while (! threadShouldExit())
+    {
+        if (! pendingChanged.exchange (false, std::memory_order_acquire))
+        {
+            wait (pollIntervalMs);
+            continue;
+        }
+
+        Patch patches[maxPending];
+        int numPatches = 0;
+
+        {
+            const juce::SpinLock::ScopedLockType scopedLock (lock);
+
+            for (int i = 0; i < numPending; ++i)
+                patches[numPatches++] = pending[i];
+
+            numPending = 0;
+        }
+
+        for (int i = 0; i < numPatches && ! threadShouldExit(); ++i)
+            renderPatch (patches[i]);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    ExcitationCache.h
+    Pre-rendered excitation bursts for the deterministic oscillator waveforms.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Data/Oscillators.h"
+#include "Data/ADSR.h"
+#include <atomic>
+#include <list>
+#include <map>
+
+//==============================================================================
+/**
+    With a sine, triangle, square or saw oscillator, the start of every note's excitation
+    depends only on the note, the wave type, the impulse envelope and the sample rate. A
+    background thread renders these bursts for all 128 notes of a patch as soon as the patch
+    is requested. Voices copy their burst into their own buffer at note on instead of running
+    the oscillator, dc blocker and envelope.
+
+    Memory is bounded: the least recently used bursts are evicted once the cache holds
+    maxBytes. The audio thread never waits for the cache - when the background thread holds
+    the lock, or the burst is not rendered yet, the voice renders live as before. Requests
+    only raise an atomic flag, which the thread polls - signalling it would take a mutex.
+
+    One instance is shared by every plugin instance in the process through
+    juce::SharedResourcePointer.
+*/
+class ExcitationCache : private juce::Thread
+{
+public:
+    static constexpr int maxBurstSamples = 8192;
+    static constexpr size_t maxBytes = 32 * 1024 * 1024;
+
+    struct Patch
+    {
+        int waveType = 0;
+        float attack = 0.0f, decay = 0.0f, sustain = 0.0f; // Impulse envelope
+        float sampleRate = 0.0f;
+
+        bool isCacheable() const { return waveType >= 0 && waveType <= 3 && sampleRate > 0.0f; } // Noise is never the same twice
+        bool operator== (const Patch& other) const;
+        bool operator< (const Patch& other) const;
+    };
+
+    ExcitationCache();
+    ~ExcitationCache() override;
+
+    // ====== MESSAGE THREAD, FROM prepareToPlay - STARTS THE THREAD, SO A PLUGIN SCAN NEVER DOES =======
+    void prepare();
+
+    // ====== ANY THREAD - RENDERS IN THE BACKGROUND, NEVER BLOCKS =======
+    void requestPatch (const Patch& patch);
+
+    // ====== AUDIO THREAD - COPIES THE BURST, RETURNS ITS LENGTH OR 0 IF IT IS NOT AVAILABLE =======
+    int copyBurst (const Patch& patch, int midiNoteNumber, float* dest, int maxSamples);
+
+    // ====== THE SAME RENDER AS THE LIVE VOICE - PHASE 0, FRESH DC BLOCKER =======
+    static int getBurstLength (const Patch& patch);
+    static void renderBurst (const Patch& patch, int midiNoteNumber, float* dest, int numSamples);
+
+private:
+    struct Key
+    {
+        Patch patch;
+        int note;
+
+        bool operator< (const Key& other) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        juce::HeapBlock<float> samples;
+        int length = 0;
+    };
+
+    void run() override;
+    void renderPatch (const Patch& patch);
+
+    std::list<Entry> entries; // Most recently used first
+    std::map<Key, std::list<Entry>::iterator> index;
+    size_t numBytes = 0;
+
+    static constexpr int maxPending = 16;
+    Patch pending[maxPending];
+    int numPending = 0;
+    std::atomic<bool> pendingChanged { false };
+
+    static constexpr int pollIntervalMs = 20;
+
+    juce::SpinLock lock; // The audio thread only ever tries it
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ExcitationCache)
+};
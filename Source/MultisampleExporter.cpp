@@ -0,0 +1,213 @@
+/*
+  ==============================================================================
+
+    MultisampleExporter.cpp
+    Offline rendering of a preset into a multisampled instrument.
+
+  ==============================================================================
+*/
+
+#include "MultisampleExporter.h"
+
+//==============================================================================
+bool MultisampleExporter::exportAll (const Options& exportOptions)
+{
+    if (! exportOptions.outputFolder.createDirectory())
+        return false;
+
+    // ====== ONE RENDER PER NOTE x VELOCITY LAYER x ROUND ROBIN =======
+    juce::Array<Render> renders;
+
+    for (int note : exportOptions.notes)
+    {
+        for (int layer = 0; layer < exportOptions.velocities.size(); ++layer)
+        {
+            for (int roundRobin = 0; roundRobin < exportOptions.roundRobins; ++roundRobin)
+            {
+                Render render;
+                render.note = note;
+                render.layer = layer;
+                render.roundRobin = roundRobin;
+                render.velocity = exportOptions.velocities[layer];
+                render.seed = exportOptions.seed + note * 1000003 + layer * 1009 + roundRobin * 17; // Independent of job order
+                render.file = exportOptions.outputFolder.getChildFile (exportOptions.namePrefix
+                                                                       + "_" + juce::String (note)
+                                                                       + "_v" + juce::String (layer + 1)
+                                                                       + "_rr" + juce::String (roundRobin + 1) + ".wav");
+                renders.add (render);
+            }
+        }
+    }
+
+    // ====== SPREAD OVER ALL CORES =======
+    {
+        const int numThreads = exportOptions.numThreads > 0 ? exportOptions.numThreads : juce::SystemStats::getNumCpus();
+        juce::ThreadPool pool (numThreads);
+
+        const std::function<bool()> shouldStop = [this] { return threadShouldExit(); };
+
+        for (auto& render : renders) // Each job only touches its own slot, so the array needs no lock
+        {
+            pool.addJob ([&exportOptions, &render, &shouldStop] // Returns void - a JobStatus lambda matches both addJob overloads
+            {
+                renderOne (exportOptions, render, shouldStop);
+            });
+        }
+
+        while (pool.getNumJobs() > 0) // The pool destructor would interrupt jobs that run long
+            juce::Thread::sleep (20);
+    }
+
+    writeManifest (exportOptions, renders);
+
+    for (auto& render : renders)
+        if (! render.succeeded)
+            return false;
+
+    return true;
+}
+
+//==============================================================================
+void MultisampleExporter::renderOne (const Options& exportOptions, Render& render, const std::function<bool()>& shouldStop)
+{
+    juce::ScopedNoDenormals noDenormals; // Per thread - the pool threads do not inherit the audio thread's flags
+    TraceScope trace ("export.renderOne", render.note);
+    const int blockSize = 512;
+    const double sampleRate = exportOptions.sampleRate;
+
+    // ====== PRIVATE SYNTH WITH A SINGLE SEEDED VOICE =======
+    auto* voice = new MySynthVoice();
+
+    juce::Synthesiser synth;
+    synth.addVoice (voice);
+    synth.addSound (new MySynthSound());
+    synth.setCurrentPlaybackSampleRate (sampleRate);
+
+    voice->setRandomSeed (render.seed);
+    voice->setUnisonLanes (UnisonString::maxStrings); // The preset is only applied after prepare - one voice, so every lane is cheap
+    voice->prepareToPlay ((int) sampleRate, blockSize, exportOptions.numChannels, 1); // Exports never oversample
+
+    if (exportOptions.applyPreset)
+        exportOptions.applyPreset (*voice);
+
+    // ====== STREAMED WAV WRITER =======
+    render.file.deleteFile();
+    std::unique_ptr<juce::FileOutputStream> stream (render.file.createOutputStream());
+
+    if (stream == nullptr)
+        return;
+
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer (wavFormat.createWriterFor (stream.get(), sampleRate,
+                                                                                (unsigned int) exportOptions.numChannels,
+                                                                                exportOptions.bitDepth, {}, 0));
+    if (writer == nullptr)
+        return;
+
+    stream.release(); // Owned by the writer now
+
+    // ====== TAIL-AWARE RENDER LOOP =======
+    const float threshold = juce::Decibels::decibelsToGain (exportOptions.trimThresholdDb);
+    const juce::int64 holdSamples = (juce::int64) (exportOptions.holdSeconds * sampleRate);
+    const juce::int64 maxSamples = (juce::int64) (exportOptions.maxSeconds * sampleRate);
+    const int silenceSamples = juce::jmax (1, (int) (exportOptions.silenceHoldSeconds * sampleRate));
+    const int fadeSamples = juce::jmax (1, (int) (exportOptions.fadeSeconds * sampleRate));
+
+    juce::AudioBuffer<float> block (exportOptions.numChannels, blockSize);
+    juce::AudioBuffer<float> pending (exportOptions.numChannels, silenceSamples + blockSize); // Quiet audio held back until we know if it is tail
+    int numPending = 0;
+    bool heardSound = false;
+
+    juce::MidiBuffer midi;
+    midi.addEvent (juce::MidiMessage::noteOn (1, render.note, render.velocity), 0);
+
+    juce::int64 numRendered = 0;
+    juce::int64 numWritten = 0;
+
+    while (numRendered < maxSamples && ! shouldStop())
+    {
+        const int numSamples = (int) juce::jmin ((juce::int64) blockSize, maxSamples - numRendered);
+
+        if (numRendered <= holdSamples && holdSamples < numRendered + numSamples)
+            midi.addEvent (juce::MidiMessage::noteOff (1, render.note), (int) (holdSamples - numRendered));
+
+        block.clear();
+        synth.renderNextBlock (block, midi, 0, numSamples);
+        midi.clear();
+        numRendered += numSamples;
+
+        const bool isLoud = block.getMagnitude (0, numSamples) > threshold;
+
+        if (isLoud || ! heardSound) // Leading silence is kept so every sample starts on its note on
+        {
+            if (numPending > 0)
+            {
+                writer->writeFromAudioSampleBuffer (pending, 0, numPending);
+                numWritten += numPending;
+                numPending = 0;
+            }
+
+            writer->writeFromAudioSampleBuffer (block, 0, numSamples);
+            numWritten += numSamples;
+            heardSound = heardSound || isLoud;
+        }
+        else
+        {
+            for (int ch = 0; ch < exportOptions.numChannels; ++ch)
+                pending.copyFrom (ch, numPending, block, ch, 0, numSamples);
+
+            numPending += numSamples;
+
+            if (numPending >= silenceSamples) // Tail has been below the threshold long enough
+                break;
+        }
+
+        if (numRendered > holdSamples && ! voice->isVoiceActive())
+            break;
+    }
+
+    // ====== FADE INTO THE TRIMMED TAIL =======
+    const int numFade = juce::jmin (fadeSamples, numPending);
+
+    if (numFade > 0)
+    {
+        pending.applyGainRamp (0, numFade, 1.0f, 0.0f);
+        writer->writeFromAudioSampleBuffer (pending, 0, numFade);
+        numWritten += numFade;
+    }
+
+    writer.reset(); // Finalises the header
+
+    render.numSamples = numWritten;
+    render.succeeded = ! shouldStop();
+}
+
+//==============================================================================
+void MultisampleExporter::writeManifest (const Options& exportOptions, const juce::Array<Render>& renders)
+{
+    juce::Array<juce::var> samples;
+
+    for (auto& render : renders) // Fixed order - the manifest is as reproducible as the audio
+    {
+        auto* entry = new juce::DynamicObject();
+        entry->setProperty ("file", render.file.getFileName());
+        entry->setProperty ("note", render.note);
+        entry->setProperty ("velocity", render.velocity);
+        entry->setProperty ("velocityLayer", render.layer + 1);
+        entry->setProperty ("roundRobin", render.roundRobin + 1);
+        entry->setProperty ("seed", render.seed);
+        entry->setProperty ("lengthInSamples", render.numSamples);
+        entry->setProperty ("ok", render.succeeded);
+        samples.add (juce::var (entry));
+    }
+
+    auto* manifest = new juce::DynamicObject();
+    manifest->setProperty ("sampleRate", exportOptions.sampleRate);
+    manifest->setProperty ("numChannels", exportOptions.numChannels);
+    manifest->setProperty ("bitDepth", exportOptions.bitDepth);
+    manifest->setProperty ("roundRobins", exportOptions.roundRobins);
+    manifest->setProperty ("samples", samples);
+
+    exportOptions.outputFolder.getChildFile (exportOptions.namePrefix + "_manifest.json")
+        .replaceWithText (juce::JSON::toString (juce::var (manifest)));
+}
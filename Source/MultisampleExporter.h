@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    MultisampleExporter.h
+    Offline rendering of a preset into a multisampled instrument.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MySynthesiser.h"
+
+//==============================================================================
+/**
+    Renders every requested note x velocity layer x round robin through its own MySynthVoice,
+    spread over a thread pool, and streams each one to a WAV file next to a JSON manifest.
+
+    Every render is seeded from its note, layer and round robin index only, so rerunning the
+    same export produces byte-identical files whatever the thread scheduling.
+*/
+class MultisampleExporter : private juce::Thread
+{
+public:
+    struct Options
+    {
+        juce::File outputFolder;
+        juce::String namePrefix { "KarPlusPlus" };
+
+        juce::Array<int> notes;          // MIDI note numbers
+        juce::Array<float> velocities;   // One entry per velocity layer, 0-1
+        int roundRobins = 1;
+        juce::int64 seed = 0;            // Base seed - different seeds give different round robin sets
+
+        double sampleRate = 48000.0;
+        int numChannels = 2;
+        int bitDepth = 24;
+
+        double holdSeconds = 1.0;        // Time between note on and note off
+        double maxSeconds = 20.0;        // Hard limit per sample
+        float trimThresholdDb = -80.0f;  // Tail below this level is trimmed
+        double silenceHoldSeconds = 0.25; // Quiet time after which a render stops
+        double fadeSeconds = 0.01;       // Fade applied where the tail is cut
+
+        int numThreads = 0;              // 0 uses every core
+
+        std::function<void (MySynthVoice&)> applyPreset; // Sets the voice parameters of the preset
+
+        static Options fullKeyboard (int numVelocityLayers)
+        {
+            Options options;
+
+            for (int note = 21; note <= 108; ++note) // 88 keys
+                options.notes.add (note);
+
+            for (int layer = 1; layer <= numVelocityLayers; ++layer)
+                options.velocities.add ((float) layer / (float) numVelocityLayers);
+
+            return options;
+        }
+    };
+
+    MultisampleExporter() : juce::Thread ("Multisample Export") {}
+
+    ~MultisampleExporter() override
+    {
+        stopThread (10000);
+    }
+
+    // ====== RUN IN THE BACKGROUND =======
+    void start (Options newOptions)
+    {
+        stopThread (10000);
+        options = std::move (newOptions);
+        startThread();
+    }
+
+    bool isExporting() const { return isThreadRunning(); }
+
+    // ====== RUN ON THE CALLING THREAD - RETURNS FALSE IF ANY FILE FAILED =======
+    bool exportAll (const Options& exportOptions);
+
+private:
+    struct Render
+    {
+        int note = 0;
+        int layer = 0;
+        int roundRobin = 0;
+        float velocity = 0.0f;
+        juce::int64 seed = 0;
+
+        juce::File file;
+        juce::int64 numSamples = 0;
+        bool succeeded = false;
+    };
+
+    void run() override
+    {
+        exportAll (options);
+    }
+
+    static void renderOne (const Options& exportOptions, Render& render, const std::function<bool()>& shouldStop);
+    static void writeManifest (const Options& exportOptions, const juce::Array<Render>& renders);
+
+    Options options;
+    juce::SharedResourcePointer<TraceRecorder> tracer; // Headless renders can be traced too
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultisampleExporter)
+};
@@ -1,7 +1,14 @@
 #pragma once
 #include "Data/StringModel.h"
+#include "Data/WaveguideString.h"
+#include "Data/ModalResonator.h"
+#include "Data/UnisonString.h"
 #include "Data/ADSR.h"
 #include "Data/Oscillators.h"
+#include "Data/DspKernels.h"
+#include "Data/MidiExpression.h"
+#include "TraceRecorder.h"
+#include "ExcitationCache.h"
 
 class MySynthSound : public juce::SynthesiserSound
 {
@@ -12,6 +19,23 @@ public:
 };
 
 
+// ====== SYNTHESISER - CONTROLLER CHANGES ALSO REACH IDLE VOICES =======
+// juce::Synthesiser only passes them to sounding voices, so a note started after the mod wheel moved would miss it.
+class MySynthesiser : public juce::Synthesiser
+{
+public:
+    void handleController (int midiChannel, int controllerNumber, int controllerValue) override
+    {
+        const juce::ScopedLock sl (lock);
+        juce::Synthesiser::handleController (midiChannel, controllerNumber, controllerValue);
+
+        for (auto* voice : voices)
+            if (! voice->isVoiceActive())
+                voice->controllerMoved (controllerNumber, controllerValue);
+    }
+};
+
+
 class MySynthVoice : public juce::SynthesiserVoice
 {
 public:
@@ -35,7 +59,26 @@ public:
                               float velToDampStringParam,
                               float velToFeedbackParam,
   
-                              float volumeParam
+                              float volumeParam,
+                              
+                              float engineParam,
+                              float pluckPosParam,
+                              float pickupPosParam,
+                              
+                              float bendRangeParam,
+                              float pitchInterpParam,
+                              
+                              float excitationSourceParam,
+                              
+                              float mpeParam,
+                              float mpeBendRangeParam,
+                              
+                              float unisonParam,
+                              float detuneParam,
+                              float spreadParam,
+                              
+                              float saturationParam,
+                              float antialiasParam
     )
     {
         attack = attackParam;
@@ -55,22 +98,111 @@ public:
         velToFeedback = velToFeedbackParam;
 
         volume = volumeParam;
+        
+        engineChoice = engineParam;
+        pluckPos = pluckPosParam;
+        pickupPos = pickupPosParam;
+        
+        bendRange = bendRangeParam;
+        karplusStrong.setInterpolation ((DelayInterpolation) juce::jlimit (0, 2, (int) pitchInterpParam));
+        waveguide.setInterpolation ((DelayInterpolation) juce::jlimit (0, 2, (int) pitchInterpParam));
+        
+        excitationSource = (int) excitationSourceParam;
+        
+        mpe = mpeParam > 0.5f;
+        mpeBendRange = mpeBendRangeParam;
+        
+        unisonCount = (int) unisonParam;
+        detune = detuneParam;
+        spread = spreadParam;
+        
+        // Cheap to set every block - the anti-aliasing history is only cleared when the order changes
+        const auto shape = (SaturationShape) juce::jlimit (0, 2, (int) saturationParam);
+        const auto antialiasing = (Antialiasing) juce::jlimit (0, 2, (int) antialiasParam);
+        karplusStrong.setSaturation (shape, antialiasing);
+        waveguide.setSaturation (shape, antialiasing);
+        unison.setSaturation (shape, antialiasing);
+    }
+    
+    // ====== PER-CHANNEL EXPRESSION - SHARED BY ALL VOICES, OWNED BY THE PROCESSOR =======
+    void setExpression (const MidiExpression* newExpression) // nullptr - pitch wheel only, e.g. exporter voices
+    {
+        expression = newExpression;
+    }
+    
+    // ====== SIDECHAIN EXCITATION - SHARED BY ALL VOICES, READ IN PLACE =======
+    void setExcitationInput (const float* input) // nullptr when there is no input this block
+    {
+        excitationInput = input;
+    }
+
+    // ====== PRE-RENDERED EXCITATION BURSTS - SHARED, OWNED BY THE PROCESSOR =======
+    void setExcitationCache (ExcitationCache* cache) // nullptr - always rendered live
+    {
+        excitationCache = cache;
+    }
+    
+    ExcitationCache::Patch getExcitationPatch() const
+    {
+        return { (int) oscType, attack, decay, sustain, sr };
     }
 
+    // ====== SEEDS EVERY RANDOM SOURCE - RENDERS BECOME REPRODUCIBLE =======
+    void setRandomSeed (juce::int64 seed)
+    {
+        karplusStrong.setRandomSeed (seed);
+        unison.setRandomSeed (seed);
+        osc.setNoiseSeed ((uint32_t) (seed ^ (seed >> 32)));
+    }
+    
+    // ====== DELAY LINE STORAGE - APPLIED ON NEXT PREPARE TO PLAY =======
+    void setDelayStorage (int storageChoice)
+    {
+        const DelayStorage storage = storageChoice == 1 ? DelayStorage::int16 : DelayStorage::float32;
+        karplusStrong.setStorage (storage);
+        waveguide.setStorage (storage);
+        unison.setStorage (storage);
+    }
+    
+    // ====== UNISON LANES - ALLOCATED ON NEXT PREPARE TO PLAY, MORE ARE NEVER USED =======
+    void setUnisonLanes (int numLanes)
+    {
+        unisonLanes = juce::jlimit (1, UnisonString::maxStrings, numLanes);
+    }
+    
     // ====== SAMPLERATE SETUP FOR PREPARE TO PLAY =======
-    void prepareToPlay(int sampleRate, int samplesPerBlock, int outputChannels)
+    void prepareToPlay(int sampleRate, int samplesPerBlock, int outputChannels, int maxRateFactor)
     {
         // SET SAMPLERATE
-        karplusStrong.setSamplerate (sampleRate);
-        osc.setSampleRate (sampleRate);
-        
-        sr = sampleRate;
+        setEngineSampleRate (sampleRate);
         
+        // ENGINE can change between any two notes without a new prepare, and a note on must not allocate, so the
+        // Karplus Strong and waveguide lines both exist for every voice. The modal bank has no lines. The unison
+        // stack is only allocated when the patch uses one.
         karplusStrong.setSize (sampleRate * 1); // Delay size of 1000ms
+        waveguide.setSize (sampleRate * 1);
+        unison.prepare (sampleRate, (float) (sampleRate * maxRateFactor), unisonLanes > 1 ? unisonLanes : 0); // Oversampled renders run the voice faster
+        
+        voiceBuffer.setSize (outputChannels, samplesPerBlock); // Voice renders here before the mix-down
+        delayModulation.allocate ((size_t) samplesPerBlock, true);
+        excitationSpan.allocate ((size_t) samplesPerBlock, true);
+        burst.allocate ((size_t) ExcitationCache::maxBurstSamples, true);
+        kernels = &DspKernels::get();
         
         isPrepared = true;
     }
     
+    // ====== SAMPLERATE CHANGE WITHOUT REALLOCATION - E.G. OVERSAMPLED OFFLINE RENDERS =======
+    // The delay lines are sized for one second at the prepared rate, which still covers the lowest MIDI note at 8x.
+    // Unison lines are sized for the offline rate up front - faster than that, their lowest notes are clamped.
+    void setCurrentPlaybackSampleRate (double newRate) override
+    {
+        juce::SynthesiserVoice::setCurrentPlaybackSampleRate (newRate);
+        
+        if (isPrepared && newRate > 0.0)
+            setEngineSampleRate ((float) newRate);
+    }
+    
     // ====== PRODUCES PARAMETER VALUES RELATIVE TO INPUT VELOCITY =======
     float velToParam (float parameter, float velocity, float amount)
     {
@@ -84,10 +216,15 @@ public:
     }
     
 
-    void startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int /*currentPitchWheelPosition*/) override
+    void startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int currentPitchWheelPosition) override
     {
+        TraceScope trace ("voice.startNote", midiNoteNumber);
+        
         playing = true;
         ending = false;
+        retiring = false;
+        retireGain = 1.0f;
+        samplesSinceStart = 0;
         
         // ====== RElATIVE VELOCITY VALUES =======
         velToLoPass = velToParam (loPass, velocity, velToLoPass);
@@ -100,13 +237,55 @@ public:
         osc.setWaveType (oscType);
         //excitation.setDampening (velToLoPass);
         
-        karplusStrong.setDampening (velToDampening);
-        karplusStrong.setFeedback (velToFeedback);
-        
         freq = juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber);
-        karplusStrong.setPitch (freq);
+        
+        midiChannel = 1;
+        for (int channel = 1; channel <= MidiExpression::numChannels; ++channel)
+            if (isPlayingChannel (channel))
+                midiChannel = channel;
+        
+        engine = (int) engineChoice; // Engine is fixed for the lifetime of a note
+        useUnison = engine == karplusEngine && juce::jmin (unisonCount, unisonLanes) > 1; // So is the stack, if it was allocated
+        
+        if (engine == waveguideEngine)
+        {
+            waveguide.setDampening (velToDampening);
+            waveguide.setFeedback (velToFeedback);
+            waveguide.setPositions (pluckPos, pickupPos);
+            waveguide.setPitch (freq);
+        }
+        else if (engine == modalEngine)
+        {
+            modal.setDampening (velToDampening);
+            modal.setFeedback (velToFeedback);
+            modal.setPitch (freq);
+            modal.reset(); // A stolen voice would otherwise ring on with the last note's modes
+        }
+        else if (useUnison)
+        {
+            unison.setStrings (unisonCount, detune, spread);
+            unison.setDampening (velToDampening);
+            unison.setFeedback (velToFeedback);
+            unison.setPitch (freq);
+        }
+        else
+        {
+            karplusStrong.setDampening (velToDampening);
+            karplusStrong.setFeedback (velToFeedback);
+            karplusStrong.setPitch (freq);
+        }
+        
+        pitchWheelMoved (currentPitchWheelPosition);
+        vibratoPhase = 0.0f;
+        pitchRatio = 1.0f;
+        pitchModulated = false;
+        appliedPressure = 0.0f; // Matches the velocity feedback and dampening set above
+        appliedTimbre = 0.5f;
+        
         osc.setFrequency (freq);
+        osc.setPhase (0.0f); // Every note starts the same way, so the excitation can come from the cache
         dcBlock.setCoefficients (juce::IIRCoefficients::makeHighPass (sr, freq));
+        dcBlock.reset();
 
         vol = velToVol;
         
@@ -120,13 +299,18 @@ public:
         generalADSR.noteOn(); // start envelope
 
         impulseADSR.reset();
+        impulseADSR.updateADSR (attack, decay, sustain, release);
         impulseADSR.noteOn();
-
+        
+        startBurst (midiNoteNumber);
     }
 
     void stopNote(float /*velocity*/, bool allowTailOff) override
     {
         // ====== TRIGGER OFF ENVELOPES =======
+        if (burstPlaying)
+            finishBurst(); // Releases from wherever the burst got to
+        
         generalADSR.noteOff();
         impulseADSR.noteOff();
 
@@ -140,45 +324,60 @@ public:
         
         if (! isVoiceActive())
             return;
+        
+        TraceScope trace ("voice.renderNextBlock", getCurrentlyPlayingNote());
 
         // ====== ADSR =======
         impulseADSR.updateADSR (attack, decay, sustain, release);
         generalADSR.updateADSR (0.1, relativeSustainTime, 1.0f, relativeSustainTime);
 
-        // ====== DSP LOOP =======
-        for (int sampleIndex = startSample; sampleIndex < (startSample + numSamples); sampleIndex++)
+        // ====== RENDER IN CHUNKS THAT FIT THE VOICE BUFFER =======
+        // Moving expression (bend ramps included) and vibrato shorten them, so the engines that retune once per chunk
+        // follow the pitch without audible steps and without reading a value per sample
+        const bool expressive = expression != nullptr
+                                && (expression->isMoving (midiChannel) || (mpe && expression->isMoving (masterChannel)));
+        const bool vibrato = modWheel > 0.0f;
+        const int maxChunk = expressive || vibrato ? juce::jmin (expressionInterval, voiceBuffer.getNumSamples()) : voiceBuffer.getNumSamples();
+        
+        while (numSamples > 0)
         {
-            // ====== ADSR =======
-            float globalEnv = generalADSR.getNextSample(); // Global envelope
-            float impulseEnv = impulseADSR.getNextSample(); // White Noise envelope
-                            
-            // ====== CHANNEL ASSIGNMENT =======
-            for (int chan = 0; chan < outputBuffer.getNumChannels(); chan++)
-            {
-                // ====== STEREO DSP =======
-                float currentSample;
-                currentSample = osc.process();
-                currentSample = dcBlock.processSingleSampleRaw (currentSample);
-                currentSample *= impulseEnv;
-                
-                currentSample = karplusStrong.process (currentSample);
-                
-                currentSample *= globalEnv; // ADSR
-                currentSample *= vol; // Volume
-                
-                outputBuffer.addSample (chan, sampleIndex, currentSample);
-                
-                if (! generalADSR.isActive())
-                    clearCurrentNote();
-            }
-                
+            int chunk = juce::jmin (numSamples, maxChunk);
+            
+            if (burstPlaying)
+                chunk = juce::jmin (chunk, burstLength - burstPos); // Hands over to the live oscillator on a chunk boundary
+            
+            renderChunk (outputBuffer, startSample, chunk);
+            
+            startSample += chunk;
+            numSamples -= chunk;
+        }
     }
+
+    // ====== LOAD GOVERNOR HOOKS =======
+    float getLevel() const { return level; } // Peak of the last rendered chunk
+    bool isRetiring() const { return retiring; }
+    juce::int64 getSamplesSinceStart() const { return samplesSinceStart; } // Levels of younger notes say little yet
+    
+    void retire() // Fades out over 5ms, then frees the voice
+    {
+        if (retiring)
+            return;
+        
+        retiring = true;
+        retireStep = 1.0f / (0.005f * sr);
     }
 
     //--------------------------------------------------------------------------
-    void pitchWheelMoved(int) override {}
+    void pitchWheelMoved(int newPitchWheelValue) override
+    {
+        pitchWheel = (float) (newPitchWheelValue - 8192) / 8192.0f; // -1 to 1, picked up by the next block
+    }
     //--------------------------------------------------------------------------
-    void controllerMoved(int, int) override {}
+    void controllerMoved(int controllerNumber, int newControllerValue) override
+    {
+        if (controllerNumber == 1) // Mod wheel sets the vibrato depth
+            modWheel = (float) newControllerValue / 127.0f;
+    }
     //--------------------------------------------------------------------------
     bool canPlaySound(juce::SynthesiserSound* sound) override
     {
@@ -187,10 +386,305 @@ public:
     //--------------------------------------------------------------------------
     
 private:
+    void setEngineSampleRate (float sampleRate)
+    {
+        karplusStrong.setSamplerate (sampleRate);
+        unison.setSamplerate (sampleRate);
+        waveguide.setSamplerate (sampleRate);
+        modal.setSamplerate (sampleRate);
+        osc.setSampleRate (sampleRate);
+        
+        generalADSR.setSampleRate (sampleRate);
+        impulseADSR.setSampleRate (sampleRate);
+        
+        sr = sampleRate;
+    }
+    
+    // ====== EXCITATION BURST FROM THE CACHE =======
+    // Replaces the oscillator, dc blocker and impulse envelope for the attack and decay. The burst keeps the
+    // pitch of the note on - the string itself still follows pitch bend and vibrato.
+    void startBurst (int midiNoteNumber)
+    {
+        burstPlaying = false;
+        
+        if (excitationCache == nullptr || excitationSource == inputSource)
+            return;
+        
+        burstLength = excitationCache->copyBurst (getExcitationPatch(), midiNoteNumber, burst.get(), ExcitationCache::maxBurstSamples);
+        burstPos = 0;
+        burstPlaying = burstLength > 0;
+    }
+    
+    // Picks up live exactly where the burst stopped
+    void finishBurst()
+    {
+        burstPlaying = false;
+        
+        // Envelope - fast forward over the samples the burst covered
+        for (int i = 0; i < burstPos; ++i)
+            impulseADSR.getNextSample();
+        
+        // Oscillator and dc blocker - primed over the last two periods, exact while the burst was shorter
+        const double phaseDelta = (double) freq / (double) sr;
+        const int primeSamples = juce::jmin (burstPos, (int) (2.0 / phaseDelta) + 1);
+        
+        osc.setPhase ((float) std::fmod ((double) (burstPos - primeSamples) * phaseDelta, 1.0));
+        dcBlock.reset();
+        
+        for (int i = 0; i < primeSamples; ++i)
+            dcBlock.processSingleSampleRaw (osc.process());
+    }
+    
+    // ====== PITCH BEND IN SEMITONES AT A SAMPLE OF THE CURRENT BLOCK =======
+    float getBendSemitones (int sample) const
+    {
+        if (expression == nullptr)
+            return pitchWheel * bendRange;
+        
+        const float channelBend = expression->getValue (midiChannel, MidiExpression::pitchBend, sample);
+        
+        if (! mpe)
+            return channelBend * bendRange;
+        
+        // MPE lower zone - channel 1 bends every note, each other channel carries one note of its own
+        const float masterBend = expression->getValue (masterChannel, MidiExpression::pitchBend, sample) * bendRange;
+        return midiChannel == masterChannel ? masterBend : masterBend + channelBend * mpeBendRange;
+    }
+    
+    // ====== PRESSURE AND TIMBRE - ONCE PER CHUNK, ONLY WHEN THEY MOVED =======
+    // Pressure lengthens the sustain towards the maximum feedback, timbre (CC74) opens or closes the loop filter
+    void updateExpression (int endSample, int numSamples)
+    {
+        if (expression == nullptr)
+            return;
+        
+        const float pressure = expression->getValue (midiChannel, MidiExpression::pressure, endSample);
+        const float timbre = expression->getValue (midiChannel, MidiExpression::timbre, endSample);
+        
+        if (pressure == appliedPressure && timbre == appliedTimbre)
+            return;
+        
+        appliedPressure = pressure;
+        appliedTimbre = timbre;
+        
+        const float noteFeedback = velToFeedback + (0.999f - velToFeedback) * pressure;
+        const float noteDampening = juce::jlimit (0.0f, 1.0f, velToDampening + timbre - 0.5f);
+        
+        if (engine == waveguideEngine)
+        {
+            waveguide.setDampening (noteDampening);
+            waveguide.setFeedback (noteFeedback);
+            waveguide.glideTo (freq * pitchRatio, numSamples); // Loop filter delay depends on the dampening
+        }
+        else if (engine == modalEngine)
+        {
+            modal.setDampening (noteDampening);
+            modal.setFeedback (noteFeedback);
+            modal.setPitch (freq * pitchRatio); // Mode decays are recalculated here
+        }
+        else if (useUnison)
+        {
+            unison.setDampening (noteDampening);
+            unison.setFeedback (noteFeedback);
+        }
+        else
+        {
+            karplusStrong.setDampening (noteDampening);
+            karplusStrong.setFeedback (noteFeedback);
+        }
+    }
+    
+    // ====== PITCH BEND AND VIBRATO - ONE RAMP PER CHUNK =======
+    // Controllers are only read here, so a voice costs the same however dense the MIDI is. The Karplus
+    // Strong loop and the waveguide follow the ramp sample by sample through fractional reads; the other engines
+    // retune once per chunk.
+    void updatePitchModulation (int startSample, int numSamples)
+    {
+        vibratoPhase += juce::MathConstants<float>::twoPi * vibratoRate * (float) numSamples / sr;
+        if (vibratoPhase > juce::MathConstants<float>::twoPi)
+            vibratoPhase -= juce::MathConstants<float>::twoPi;
+        
+        const float semitones = getBendSemitones (startSample + numSamples) + modWheel * maxVibratoDepth * std::sin (vibratoPhase);
+        const float targetRatio = std::exp2 (semitones / 12.0f);
+        
+        if (targetRatio == pitchRatio && ! pitchModulated)
+            return; // Unmodulated - integer read path
+        
+        if (useUnison)
+        {
+            unison.setPitch (freq * targetRatio); // Fractional taps - retuned once per chunk like the waveguide
+        }
+        else if (engine == karplusEngine)
+        {
+            // Loop length ramps from the last chunk's end value, so there are no steps at chunk boundaries
+            const float baseDelay = karplusStrong.getDelayTimeInSamples();
+            const float startDelay = baseDelay / pitchRatio;
+            const float step = (baseDelay / targetRatio - startDelay) / (float) numSamples;
+            
+            float* delays = delayModulation.get();
+            for (int i = 0; i < numSamples; ++i)
+                delays[i] = startDelay + step * (float) (i + 1);
+        }
+        else if (engine == waveguideEngine)
+        {
+            waveguide.glideTo (freq * targetRatio, numSamples); // Fractional read ramps over the chunk
+        }
+        else
+        {
+            modal.setPitch (freq * targetRatio);
+        }
+        
+        osc.setFrequency (freq * targetRatio);
+        pitchRatio = targetRatio;
+        pitchModulated = true; // Stays on for the rest of the note so the read path never switches mid-tone
+    }
+    
+    void renderChunk (juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples)
+    {
+        const int numChannels = juce::jmin (outputBuffer.getNumChannels(), voiceBuffer.getNumChannels());
+        float peak = 0.0f;
+        
+        updateExpression (startSample + numSamples, numSamples);
+        updatePitchModulation (startSample, numSamples);
+        const bool modulatedLoop = pitchModulated && engine == karplusEngine && ! useUnison;
+        float* left = voiceBuffer.getWritePointer (0);
+        float* right = voiceBuffer.getWritePointer (numChannels > 1 ? 1 : 0);
+        
+        // Without a connected input the oscillator still plays, so MIDI notes are never silent
+        const float* input = excitationSource != oscillatorSource && excitationInput != nullptr ? excitationInput + startSample : nullptr;
+        const bool useOscillator = excitationSource != inputSource || input == nullptr;
+        
+        if (burstPlaying && ! useOscillator)
+            finishBurst();
+        
+        const float* burstSamples = burstPlaying ? burst.get() + burstPos : nullptr;
+        
+        float* excitation = excitationSpan.get();
+        
+        // ====== EXCITATION =======
+        for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+        {
+            float impulseEnv = burstSamples != nullptr ? 0.0f : impulseADSR.getNextSample(); // White Noise envelope - the burst has it applied already
+            float currentSample = 0.0f;
+            
+            if (burstSamples != nullptr)
+            {
+                currentSample = burstSamples[sampleIndex];
+            }
+            else if (useOscillator)
+            {
+                currentSample = osc.process();
+                currentSample = dcBlock.processSingleSampleRaw (currentSample);
+                currentSample *= impulseEnv;
+            }
+            
+            if (input != nullptr)
+                currentSample += input[sampleIndex];
+            
+            excitation[sampleIndex] = currentSample;
+        }
+        
+        // ====== STRING - ONCE PER SAMPLE, THEN PLACED IN THE STEREO FIELD =======
+        if (useUnison)
+        {
+            for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+            {
+                float leftSample = 0.0f, rightSample = 0.0f;
+                unison.process (excitation[sampleIndex], leftSample, rightSample);
+                
+                if (numChannels > 1)
+                {
+                    left[sampleIndex] = leftSample;
+                    right[sampleIndex] = rightSample;
+                }
+                else
+                {
+                    left[sampleIndex] = 0.5f * (leftSample + rightSample);
+                }
+            }
+        }
+        else
+        {
+            if (engine == karplusEngine && ! modulatedLoop)
+            {
+                karplusStrong.processBlock (excitation, left, numSamples); // Spans of up to one loop length
+            }
+            else if (engine == karplusEngine)
+            {
+                karplusStrong.processModulated (excitation, left, delayModulation.get(), numSamples);
+            }
+            else
+            {
+                for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+                {
+                    float currentSample = excitation[sampleIndex];
+                    
+                    if (engine == waveguideEngine)
+                        currentSample = waveguide.process (currentSample);
+                    else
+                        currentSample = modal.process (currentSample);
+                    
+                    left[sampleIndex] = currentSample;
+                }
+            }
+            
+            if (numChannels > 1)
+                juce::FloatVectorOperations::copy (right, left, numSamples);
+        }
+        
+        // ====== ADSR =======
+        for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+        {
+            float globalEnv = generalADSR.getNextSample(); // Global envelope
+            
+            if (retiring)
+            {
+                retireGain = juce::jmax (0.0f, retireGain - retireStep);
+                globalEnv *= retireGain;
+            }
+            
+            left[sampleIndex] *= globalEnv;
+            
+            if (numChannels > 1)
+                right[sampleIndex] *= globalEnv;
+            
+            peak = juce::jmax (peak, std::abs (left[sampleIndex]), std::abs (right[sampleIndex]));
+            
+            if (! generalADSR.isActive())
+                clearCurrentNote();
+        }
+        
+        level = peak * vol;
+        samplesSinceStart += numSamples;
+        
+        if (burstPlaying)
+        {
+            burstPos += numSamples;
+            
+            if (burstPos >= burstLength)
+                finishBurst();
+        }
+        
+        if (retiring && retireGain <= 0.0f)
+            clearCurrentNote();
+        
+        // ====== MIX-DOWN WITH VOLUME =======
+        for (int chan = 0; chan < numChannels; chan++)
+            kernels->addWithGain (outputBuffer.getWritePointer (chan, startSample), voiceBuffer.getReadPointer (chan), vol, numSamples);
+    }
+    
+
     // ====== NOTE ON/OFF =======   
     bool playing = false;
     bool ending = false;
     
+    // ====== LOAD GOVERNOR =======
+    bool retiring = false;
+    float retireGain = 1.0f;
+    float retireStep = 0.0f;
+    float level = 0.0f;
+    juce::int64 samplesSinceStart = 0;
+    
     // ====== JASSERTS =======
     bool isPrepared { false };
 
@@ -214,14 +708,74 @@ private:
     
     float volume;
     
+    float engineChoice = 0.0f;
+    float pluckPos;
+    float pickupPos;
+    
+    float bendRange = 2.0f; // Semitones
+    
+    // ====== UNISON =======
+    int unisonCount = 1;
+    int unisonLanes = 1; // Allocated at prepare
+    float detune = 0.0f; // Cents between the outer strings
+    float spread = 0.0f;
+    bool useUnison = false; // Latched at note on
+    
+    // ====== EXCITATION SOURCE =======
+    static constexpr int oscillatorSource = 0;
+    static constexpr int inputSource = 1; // 2 = oscillator and input
+    int excitationSource = oscillatorSource;
+    const float* excitationInput = nullptr; // Owned by the processor
+    
+    // ====== EXCITATION CACHE =======
+    ExcitationCache* excitationCache = nullptr;
+    juce::HeapBlock<float> burst; // The voice's own copy - the cache may evict it while the note plays
+    int burstLength = 0;
+    int burstPos = 0;
+    bool burstPlaying = false;
+    
+    // ====== PITCH MODULATION =======
+    float pitchWheel = 0.0f;
+    float modWheel = 0.0f;
+    float vibratoPhase = 0.0f;
+    float pitchRatio = 1.0f; // Reached at the end of the last chunk
+    bool pitchModulated = false;
+    juce::HeapBlock<float> delayModulation; // Per-sample loop length of the current chunk
+    juce::HeapBlock<float> excitationSpan; // Excitation of the current chunk - the string takes it as one span
+    
+    static constexpr float vibratoRate = 5.5f; // Hz
+    static constexpr float maxVibratoDepth = 0.5f; // Semitones at full mod wheel
+    
+    // ====== MPE / PER-CHANNEL EXPRESSION =======
+    const MidiExpression* expression = nullptr;
+    bool mpe = false;
+    float mpeBendRange = 48.0f; // Semitones, per-note channels
+    int midiChannel = 1; // Channel of the current note
+    float appliedPressure = 0.0f;
+    float appliedTimbre = 0.5f;
+    
+    static constexpr int masterChannel = 1;
+    static constexpr int expressionInterval = 32; // Samples per chunk while expression moves
+    
     // ====== ENVELOPES =======
     ADSRData generalADSR, impulseADSR;
     float relativeSustainTime;
 
-    juce::Random random;
     juce::IIRFilter dcBlock;
     
+    // ====== STRING ENGINES =======
+    static constexpr int karplusEngine = 0;
+    static constexpr int waveguideEngine = 1;
+    static constexpr int modalEngine = 2;
+    int engine = karplusEngine;
+    
     KarplusStrong karplusStrong;
+    UnisonString unison; // Karplus Strong stack - replaces the single string while UNISON is above 1
+    WaveguideString waveguide;
+    ModalResonator modal; // No delay line - constant size whatever the pitch
+    
+    juce::AudioSampleBuffer voiceBuffer;
+    const DspKernels* kernels = nullptr;
     
     Oscillator osc;
     
@@ -14,26 +14,91 @@
 //==============================================================================
 KarPlusPlus2AudioProcessor::KarPlusPlus2AudioProcessor()
 : foleys::MagicProcessor  (juce::AudioProcessor::BusesProperties()
+                           .withInput ("Sidechain", juce::AudioChannelSet::stereo(), false) // Optional - excites the strings
                            .withOutput("Output", juce::AudioChannelSet::stereo(), true)),
     apvts (*this, nullptr, "ParamTreeID", createParams())
 {
-    // ====== GUI MAGIC =======
+    const double startTime = juce::Time::getMillisecondCounterHiRes();
+    
+    // ====== GUI MAGIC - THE TREE AND THE ANALYSER WAIT FOR createEditor() =======
     
     //    FOLEYS_SET_SOURCE_PATH (__FILE__);
-    magicState.setGuiValueTree (BinaryData::GUImagic_xml, BinaryData::GUImagic_xmlSize); // Load custom GUI
-    analyser = magicState.createAndAddObject<foleys::MagicAnalyser>("input");
+    magicState.addTrigger ("exportMultisamples", [this]
+    {
+        exportFileChooser = std::make_unique<juce::FileChooser> ("Export Multisamples To", juce::File());
+        exportFileChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+                                        [this] (const juce::FileChooser& chooser)
+                                        {
+                                            if (chooser.getResult() == juce::File())
+                                                return;
+                                            
+                                            auto options = MultisampleExporter::Options::fullKeyboard (8);
+                                            options.outputFolder = chooser.getResult();
+                                            options.sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 48000.0;
+                                            exportMultisamples (apvts.copyState(), std::move (options));
+                                        });
+    });
     
-    // ====== CONSTRUCTOR TO SET UP POLYPHONY =======
-    for (int i = 0; i < voiceCount; i++)
+    magicState.addTrigger ("recordTrace", [this]
     {
-        synth.addVoice (new MySynthVoice()); //Synth Voice makes the sound
-    }
-
+        if (tracer->isRecording())
+        {
+            tracer->stop();
+            magicState.getPropertyAsValue ("trace:status").setValue ("Trace saved to " + tracer->getOutputFile().getFullPathName());
+            return;
+        }
+        
+        const juce::File file = juce::File::getSpecialLocation (juce::File::userDesktopDirectory)
+                                    .getNonexistentChildFile ("KarPlusPlus_trace", ".json");
+        
+        magicState.getPropertyAsValue ("trace:status").setValue (tracer->start (file) ? "Recording trace..." : "Cannot write trace");
+    });
+    
+    magicState.addTrigger ("loadBodyIR", [this]
+    {
+        bodyFileChooser = std::make_unique<juce::FileChooser> ("Load Body Impulse Response", juce::File(), "*.wav;*.aif;*.aiff;*.flac");
+        bodyFileChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                      [this] (const juce::FileChooser& chooser)
+                                      {
+                                          if (chooser.getResult().existsAsFile())
+                                              loadBodyImpulseResponse (chooser.getResult());
+                                      });
+    });
+    
+    // Voices are only built in prepareToPlay - plugin scans and frozen tracks never pay for them
     synth.addSound (new MySynthSound()); // Synth Sound allocates
+    
+    startupTimings.constructionMs = juce::Time::getMillisecondCounterHiRes() - startTime;
+    DBG ("KarPlusPlus constructed in " << startupTimings.constructionMs << " ms");
+}
+
+// =============== EDITOR - GUI TREE IS PARSED ON FIRST OPEN ====================
+juce::AudioProcessorEditor* KarPlusPlus2AudioProcessor::createEditor()
+{
+    if (! guiLoaded)
+    {
+        const double startTime = juce::Time::getMillisecondCounterHiRes();
+        
+        magicState.setGuiValueTree (BinaryData::GUImagic_xml, BinaryData::GUImagic_xmlSize); // Load custom GUI
+        
+        auto* newAnalyser = magicState.createAndAddObject<foleys::MagicAnalyser>("input");
+        if (getSampleRate() > 0.0)
+            newAnalyser->prepareToPlay (getSampleRate(), getBlockSize());
+        analyser.store (newAnalyser); // Audio thread starts feeding it from here on
+        
+        guiLoaded = true;
+        startTimerHz (10); // Only the GUI shows the governor status
+        
+        startupTimings.editorMs = juce::Time::getMillisecondCounterHiRes() - startTime;
+        DBG ("KarPlusPlus GUI loaded in " << startupTimings.editorMs << " ms");
+    }
+    
+    return foleys::MagicProcessor::createEditor();
 }
 
 KarPlusPlus2AudioProcessor::~KarPlusPlus2AudioProcessor()
 {
+    stopTimer();
 }
 
 //==============================================================================
@@ -101,15 +166,161 @@ void KarPlusPlus2AudioProcessor::changeProgramName(int index, const juce::String
 // =============== PREPARE TO PLAY - SAMPLERATE SETUP ====================
 void KarPlusPlus2AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    synth.setCurrentPlaybackSampleRate(sampleRate);
+    const double startTime = juce::Time::getMillisecondCounterHiRes();
+    
+    // ====== POLYPHONY - BUILT ON FIRST PREPARE =======
+    if (synth.getNumVoices() == 0)
+    {
+        for (int i = 0; i < voiceCount; i++)
+        {
+            synth.addVoice (new MySynthVoice()); //Synth Voice makes the sound
+        }
+    }
+    
+    // ====== INTERNAL RATE - THE ENGINE RUNS AT host / internalFactor =======
+    // Like the delay storage it is only picked up here, as every engine buffer depends on it
+    internalFactor = getInternalRateFactor (sampleRate, (int) apvts.getRawParameterValue ("INTERNALRATE")->load());
+    const double engineRate = sampleRate / internalFactor;
+    const int engineBlockSize = samplesPerBlock / internalFactor + 1; // Host blocks need not divide evenly
     
-    analyser->prepareToPlay (sampleRate, samplesPerBlock);
+    upsampler.prepare (internalFactor, getTotalNumOutputChannels());
+    internalBuffer.setSize (getTotalNumOutputChannels(), engineBlockSize);
+    internalMidi.ensureSize (4096);
+    internalMidi.clear();
+    
+    engineSampleRate = engineRate;
+    oversamplingOrder = 0;
+    updateLatency();
+    synth.setCurrentPlaybackSampleRate(engineRate);
+    
+    if (auto* plotSource = analyser.load())
+        plotSource->prepareToPlay (sampleRate, samplesPerBlock);
+
+    // Storage format reallocates the delay lines, so it is only picked up here
+    const int delayStorage = (int) apvts.getRawParameterValue ("DELAYSTORAGE")->load();
 
+    excitationCache->prepare(); // Background renderer - not started by the constructor, so a plugin scan stays cheap
+    
+    // So are the unison lanes the patch uses and the offline rate they are sized for
+    const int unisonLanes = (int) apvts.getRawParameterValue ("UNISON")->load();
+    const int offlineOrder = (int) apvts.getRawParameterValue ("OFFLINEQUALITY")->load();
+    
     for (int i = 0; i < voiceCount; i++)
     {
         MySynthVoice* v = dynamic_cast<MySynthVoice*>(synth.getVoice(i)); //returns a pointer to synthesiser voice
-        v->prepareToPlay(sampleRate, samplesPerBlock, getTotalNumOutputChannels());
+        v->setDelayStorage (delayStorage);
+        v->setUnisonLanes (unisonLanes);
+        v->setExpression (&expression);
+        v->setExcitationCache (excitationCache.get());
+        v->prepareToPlay(engineRate, engineBlockSize << maxOversamplingOrder, getTotalNumOutputChannels(), 1 << offlineOrder); // Room for the 8x block
+    }
+    
+    // Both paths exist before playback starts, so switching between them never allocates
+    for (int order = 1; order <= maxOversamplingOrder; ++order)
+    {
+        auto& oversampler = oversamplers[order - 1];
+        oversampler = std::make_unique<juce::dsp::Oversampling<float>> ((size_t) getTotalNumOutputChannels(), (size_t) order,
+                                                                        juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, true);
+        oversampler->initProcessing ((size_t) engineBlockSize);
     }
+    
+    oversampledMidi.ensureSize (4096);
+    
+    excitationInput.setSize (1, samplesPerBlock << maxOversamplingOrder); // Room for the 8x block
+    excitationInput.clear();
+    lastInputSample = 0.0f;
+    follower.prepare (sampleRate);
+    expression.prepare();
+    
+    governor.prepare (sampleRate, samplesPerBlock);
+    
+    sympathetic.prepare (engineRate);
+    body.prepare ({ engineRate, (juce::uint32) engineBlockSize, (juce::uint32) getTotalNumOutputChannels() });
+
+    startupTimings.prepareMs = juce::Time::getMillisecondCounterHiRes() - startTime;
+    DBG ("KarPlusPlus prepared in " << startupTimings.prepareMs << " ms");
+}
+
+// =============== BODY IMPULSE RESPONSE ====================
+void KarPlusPlus2AudioProcessor::loadBodyImpulseResponse (const juce::File& file)
+{
+    body.loadImpulseResponse (file);
+    magicState.getPropertyAsValue ("body:file").setValue (file.getFullPathName()); // Stored with the plugin state
+}
+
+void KarPlusPlus2AudioProcessor::postSetStateInformation()
+{
+    const juce::File file (magicState.getPropertyAsValue ("body:file").toString());
+    
+    if (file.existsAsFile())
+        body.loadImpulseResponse (file);
+}
+
+// =============== VOICE PARAMETERS ====================
+// getParam (paramID) returns the current value - the live APVTS or a stored preset
+template <typename ParameterGetter>
+static void setVoiceParameters (MySynthVoice& voice, ParameterGetter&& getParam)
+{
+    voice.setParameterPointers(
+                               getParam ("ATTACK"),
+                               getParam ("DECAY"),
+                               getParam ("SUSTAIN"),
+                               getParam ("RELEASE"),
+                               
+                               getParam ("OSC"),
+                               
+                               getParam ("LOPASS"),
+                           
+                               getParam ("DAMPSTRING"),
+                               getParam ("FEEDBACK"),
+                               
+                               getParam ("VELTOLOPASS"),
+                               getParam ("VELTODAMPENSTRING"),
+                               getParam ("VELTOFEEDBACK"),
+   
+                               getParam ("VOLUME"),
+                               
+                               getParam ("ENGINE"),
+                               getParam ("PLUCKPOS"),
+                               getParam ("PICKUPPOS"),
+                               
+                               getParam ("BENDRANGE"),
+                               getParam ("PITCHINTERP"),
+                               
+                               getParam ("EXCITESOURCE"),
+                               
+                               getParam ("MPE"),
+                               getParam ("MPEBENDRANGE"),
+                               
+                               getParam ("UNISON"),
+                               getParam ("UNISONDETUNE"),
+                               getParam ("UNISONSPREAD"),
+                               
+                               getParam ("SATURATION"),
+                               getParam ("ANTIALIAS")
+        );
+}
+
+// =============== MULTISAMPLE EXPORT ====================
+void KarPlusPlus2AudioProcessor::exportMultisamples (const juce::ValueTree& preset, MultisampleExporter::Options options)
+{
+    // Snapshot of every parameter: current values, overridden by whatever the preset stores
+    std::map<juce::String, float> values;
+
+    for (auto* param : getParameters())
+        if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*> (param))
+            values[ranged->getParameterID()] = apvts.getRawParameterValue (ranged->getParameterID())->load();
+
+    for (const auto& child : preset)
+        if (child.hasProperty ("id") && values.count (child["id"].toString()) > 0)
+            values[child["id"].toString()] = (float) child["value"];
+
+    options.applyPreset = [values] (MySynthVoice& voice)
+    {
+        setVoiceParameters (voice, [&values] (const char* paramID) { return values.at (paramID); });
+    };
+
+    exporter.start (std::move (options));
 }
 
 void KarPlusPlus2AudioProcessor::releaseResources()
@@ -131,6 +342,12 @@ bool KarPlusPlus2AudioProcessor::isBusesLayoutSupported(const BusesLayout& layou
         && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
         return false;
 
+    // The sidechain is optional - off, mono or stereo
+    if (! layouts.getMainInputChannelSet().isDisabled()
+        && layouts.getMainInputChannelSet() != juce::AudioChannelSet::mono()
+        && layouts.getMainInputChannelSet() != juce::AudioChannelSet::stereo())
+        return false;
+
     // This checks if the input layout matches the output layout
 #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
@@ -146,60 +363,363 @@ bool KarPlusPlus2AudioProcessor::isBusesLayoutSupported(const BusesLayout& layou
 void KarPlusPlus2AudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    TraceScope trace ("processBlock", buffer.getNumSamples());
+    governor.beginBlock();
     
     magicState.processMidiBuffer (midiMessages, buffer.getNumSamples());
     
     // ====== UPDATE PARAMETERS =======
+    {
+        TraceScope parameterTrace ("updateParameters");
+        
+        for (int i = 0; i < synth.getNumVoices(); ++i)
+        {
+            // ====== SYNTH VOICE CAST =======
+            if (auto voice = dynamic_cast<MySynthVoice*>(synth.getVoice(i)))
+            {
+                // ====== CONVERT ATOMIC PARAMETERS TO FLOATS =======
+                setVoiceParameters (*voice, [this] (const char* paramID) { return apvts.getRawParameterValue (paramID)->load(); });
+            }
+        }
+    }
+
+    // ====== QUALITY FOLLOWS THE HOST'S OFFLINE STATE =======
+    const int offlineOrder = (int) apvts.getRawParameterValue ("OFFLINEQUALITY")->load();
+    setOversamplingOrder (isNonRealtime() ? offlineOrder : 0);
+
+    // ====== DEGRADE UNDER LOAD - LIVE PLAYBACK ONLY =======
+    if (isNonRealtime())
+        governor.reset();
+    else
+        applyGovernor();
+    
+    const int governorTier = governor.getTier();
+    
+    // ====== EXCITATION CACHE - A CHANGED PATCH IS PRE-RENDERED IN THE BACKGROUND =======
+    if (auto voice = dynamic_cast<MySynthVoice*> (synth.getVoice (0)))
+    {
+        const auto patch = voice->getExcitationPatch(); // At the rate the voices run at, after oversampling
+        
+        if (! (patch == lastExcitationPatch))
+        {
+            excitationCache->requestPatch (patch);
+            lastExcitationPatch = patch;
+        }
+    }
+    
+    // ====== SIDECHAIN EXCITATION =======
+    const float* input = captureExcitationInput (buffer, midiMessages);
+    
     for (int i = 0; i < synth.getNumVoices(); ++i)
+        if (auto voice = dynamic_cast<MySynthVoice*> (synth.getVoice (i)))
+            voice->setExcitationInput (input);
+
+    // ====== DSP PROCESSING - AT THE INTERNAL RATE, THEN ONE RESAMPLER FOR THE WHOLE MIX =======
+    if (internalFactor > 1)
     {
-        // ====== SYNTH VOICE CAST =======
-        if (auto voice = dynamic_cast<MySynthVoice*>(synth.getVoice(i)))
+        const int numEngineSamples = upsampler.getNumInputSamplesNeeded (buffer.getNumSamples());
+        juce::AudioBuffer<float> engineBuffer (internalBuffer.getArrayOfWritePointers(), internalBuffer.getNumChannels(), numEngineSamples); // No allocation
+        engineBuffer.clear();
+        
+        // Engine sample i ends up at host sample numBuffered + i * internalFactor
+        for (const auto metadata : midiMessages)
+            internalMidi.addEvent (metadata.getMessage(), juce::jlimit (0, juce::jmax (0, numEngineSamples - 1),
+                                                                        (metadata.samplePosition - upsampler.getNumBuffered()) / internalFactor));
+        
+        if (numEngineSamples > 0) // Tiny host blocks can be served from the leftover alone - their MIDI waits for the next one
         {
-            // ====== PARAMETERS =======
-            auto& attackParam = *apvts.getRawParameterValue("ATTACK");
-            auto& decayParam = *apvts.getRawParameterValue("DECAY");
-            auto& sustainParam = *apvts.getRawParameterValue("SUSTAIN");
-            auto& releaseParam = *apvts.getRawParameterValue("RELEASE");
-            
-            auto& oscWaveChoice = *apvts.getRawParameterValue("OSC");
+            renderEngine (engineBuffer, internalMidi, governorTier);
+            internalMidi.clear();
+        }
+        
+        upsampler.process (engineBuffer, buffer);
+    }
+    else
+    {
+        renderEngine (buffer, midiMessages, governorTier);
+    }
+    
+    auto* plotSource = analyser.load();
+    
+    if (plotSource != nullptr && governorTier < LoadGovernor::noAnalyser)
+    {
+        TraceScope analyserTrace ("analyser.pushSamples");
+        plotSource->pushSamples (buffer);
+    }
+    
+    governor.endBlock (buffer.getNumSamples());
+}
+
+// =============== ENGINE - VOICES AND SHARED RESONANCE ====================
+void KarPlusPlus2AudioProcessor::renderEngine (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages, int governorTier)
+{
+    {
+        TraceScope synthTrace ("synth.renderNextBlock", buffer.getNumSamples());
+        
+        // Pitch bend, pressure and CC74 are taken out here - the synth only splits the block at notes and other controllers
+        expression.extract (midiMessages, 1 << oversamplingOrder);
+        
+        if (oversamplingOrder > 0)
+            renderOversampled (buffer, midiMessages);
+        else
+            synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+        
+        lastEngineBlockSize = buffer.getNumSamples() << oversamplingOrder; // At the rate the voices run at
+    }
+    
+    // ====== SHARED RESONANCE =======
+    TraceScope resonanceTrace ("sympathetic+body");
+    sympathetic.setTuning ((int) apvts.getRawParameterValue ("SYMPROOT")->load(),
+                           (int) apvts.getRawParameterValue ("SYMPSCALE")->load(),
+                           (int) apvts.getRawParameterValue ("SYMPSTRINGS")->load());
+    sympathetic.setDecay (apvts.getRawParameterValue ("SYMPDECAY")->load());
+    sympathetic.setDampening (apvts.getRawParameterValue ("DAMPSTRING")->load());
+    sympathetic.process (buffer, governorTier >= LoadGovernor::noResonance ? 0.0f : apvts.getRawParameterValue ("SYMPMIX")->load());
+    
+    body.setMix (apvts.getRawParameterValue ("BODYMIX")->load());
+    body.process (buffer);
+}
+
+int KarPlusPlus2AudioProcessor::getInternalRateFactor (double hostRate, int rateChoice)
+{
+    if (rateChoice == 0) // Host rate
+        return 1;
+    
+    const double minimumRate = rateChoice == 1 ? 44100.0 : 88200.0; // 44.1 and 48 kHz sessions alike
+    int factor = 1;
+    
+    while (factor < PolyphaseUpsampler::maxFactor && hostRate / (factor * 2) >= minimumRate * 0.999)
+        factor *= 2;
+    
+    return factor;
+}
+
+// =============== SIDECHAIN EXCITATION ====================
+const float* KarPlusPlus2AudioProcessor::captureExcitationInput (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    const int numInputChannels = juce::jmin (getTotalNumInputChannels(), buffer.getNumChannels());
+    const int numSamples = buffer.getNumSamples();
+    const int source = (int) apvts.getRawParameterValue ("EXCITESOURCE")->load();
+    
+    if (numInputChannels == 0 || source == 0) // Oscillator only
+    {
+        follower.releaseNote (midiMessages);
+        return nullptr;
+    }
+    
+    // ====== ONE MONO SUM FOR EVERY VOICE =======
+    // The host passes input and output in the same channels, so the input has to leave the buffer before the voices add to it
+    excitationInput.copyFrom (0, 0, buffer, 0, 0, numSamples);
+    
+    for (int ch = 1; ch < numInputChannels; ++ch)
+        excitationInput.addFrom (0, 0, buffer, ch, 0, numSamples);
+    
+    if (numInputChannels > 1)
+        excitationInput.applyGain (0, 0, numSamples, 1.0f / (float) numInputChannels);
+    
+    for (int ch = 0; ch < numInputChannels; ++ch)
+        buffer.clear (ch, 0, numSamples);
+    
+    // ====== INPUT FOLLOWER - NOTES GO INTO THE HOST'S MIDI BEFORE THE SYNTH READS IT =======
+    if (apvts.getRawParameterValue ("INPUTTRIGGER")->load() > 0.5f)
+    {
+        follower.setThreshold (apvts.getRawParameterValue ("INPUTTHRESHOLD")->load());
+        follower.process (excitationInput.getReadPointer (0), numSamples, midiMessages,
+                          (int) apvts.getRawParameterValue ("INPUTNOTE")->load());
+    }
+    else
+    {
+        follower.releaseNote (midiMessages);
+    }
+    
+    // ====== INTERNAL RATE - BOX AVERAGE OVER EACH ENGINE SAMPLE'S HOST SAMPLES, IN PLACE, FIRST SAMPLE FIRST =======
+    float* data = excitationInput.getWritePointer (0);
+    int numEngineSamples = numSamples;
+    
+    if (internalFactor > 1)
+    {
+        numEngineSamples = upsampler.getNumInputSamplesNeeded (numSamples);
+        
+        for (int i = 0; i < numEngineSamples; ++i) // Only reads indices >= i, which are still untouched
+        {
+            const int last = juce::jmin (numSamples - 1, upsampler.getNumBuffered() + i * internalFactor);
+            const int first = juce::jmax (0, last - internalFactor + 1);
+            float sum = 0.0f;
             
-            auto& loPassParam = *apvts.getRawParameterValue("LOPASS");
+            for (int k = first; k <= last; ++k)
+                sum += data[k];
             
-            auto& dampStringParam = *apvts.getRawParameterValue("DAMPSTRING");
-            auto& feedbackParam = *apvts.getRawParameterValue("FEEDBACK");
-   
-            auto& VelToLoPassParam = *apvts.getRawParameterValue("VELTOLOPASS");
-            auto& velToDampStringParam = *apvts.getRawParameterValue("VELTODAMPENSTRING");
-            auto& velToFeedbackParam = *apvts.getRawParameterValue("VELTOFEEDBACK");
+            data[i] = sum / (float) (last - first + 1);
+        }
+    }
+    
+    if (numEngineSamples == 0)
+        return data;
+    
+    // ====== OVERSAMPLED RENDERS - LINEAR UPSAMPLING IN PLACE, LAST SAMPLE FIRST =======
+    const float previous = lastInputSample;
+    lastInputSample = data[numEngineSamples - 1];
+    
+    if (oversamplingOrder > 0)
+    {
+        const int factor = 1 << oversamplingOrder;
+        
+        for (int j = numEngineSamples * factor - 1; j >= 0; --j) // Only reads indices <= j, which are still untouched
+        {
+            const int k = j / factor;
+            const float from = k > 0 ? data[k - 1] : previous;
+            data[j] = from + (data[k] - from) * (float) (j - k * factor + 1) / (float) factor;
+        }
+    }
+    
+    return data;
+}
+
+// =============== LOAD GOVERNOR ====================
+void KarPlusPlus2AudioProcessor::applyGovernor()
+{
+    const int tier = governor.getTier();
+    
+    if (tier == LoadGovernor::fullQuality)
+        return;
+    
+    // ====== RETIRE QUIET RELEASED TAILS =======
+    int numActive = 0;
+    
+    for (int i = 0; i < synth.getNumVoices(); ++i)
+    {
+        if (auto voice = dynamic_cast<MySynthVoice*> (synth.getVoice (i)))
+        {
+            if (! voice->isVoiceActive() || voice->isRetiring())
+                continue;
             
-            auto& volumeParam = *apvts.getRawParameterValue("VOLUME");
+            if (tier >= LoadGovernor::retiredTails && isReleased (*voice) && voice->getLevel() < 0.03f) // Below about -30dB
+                voice->retire();
+            else
+                ++numActive;
+        }
+    }
+    
+    // ====== CAP POLYPHONY - QUIETEST RELEASED VOICE, ELSE THE OLDEST =======
+    // Notes struck during the last block have barely rendered, so their level would put them first in line
+    const int cap = governor.getVoiceCap (synth.getNumVoices());
+    
+    while (numActive > cap)
+    {
+        MySynthVoice* quietestReleased = nullptr;
+        MySynthVoice* oldest = nullptr;
+        MySynthVoice* oldestNew = nullptr;
+        
+        for (int i = 0; i < synth.getNumVoices(); ++i)
+        {
+            auto voice = dynamic_cast<MySynthVoice*> (synth.getVoice (i));
             
-            // ====== CONVERT ATOMIC PARAMETERS TO FLOATS =======
-            voice->setParameterPointers(
-                                        attackParam.load(),
-                                        decayParam.load(),
-                                        sustainParam.load(),
-                                        releaseParam.load(),
-                                        
-                                        oscWaveChoice.load(),
-                                        
-                                        loPassParam.load(),
-                                    
-                                        dampStringParam.load(),
-                                        feedbackParam.load(),
-                                        
-                                        VelToLoPassParam.load(),
-                                        velToDampStringParam.load(),
-                                        velToFeedbackParam.load(),
+            if (voice == nullptr || ! voice->isVoiceActive() || voice->isRetiring())
+                continue;
             
-                                        volumeParam.load()
-                );
+            if (voice->getSamplesSinceStart() < lastEngineBlockSize)
+            {
+                if (oldestNew == nullptr || voice->wasStartedBefore (*oldestNew))
+                    oldestNew = voice;
+            }
+            else if (isReleased (*voice))
+            {
+                if (quietestReleased == nullptr || voice->getLevel() < quietestReleased->getLevel())
+                    quietestReleased = voice;
+            }
+            else if (oldest == nullptr || voice->wasStartedBefore (*oldest))
+            {
+                oldest = voice;
+            }
         }
+        
+        auto* victim = quietestReleased != nullptr ? quietestReleased : (oldest != nullptr ? oldest : oldestNew);
+        
+        if (victim == nullptr)
+            break;
+        
+        victim->retire();
+        --numActive;
     }
+}
+
+bool KarPlusPlus2AudioProcessor::isReleased (const MySynthVoice& voice)
+{
+    return ! voice.isKeyDown() && ! voice.isSustainPedalDown();
+}
 
-    // ====== DSP PROCESSING =======
-    synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
-    analyser->pushSamples (buffer);
+void KarPlusPlus2AudioProcessor::timerCallback()
+{
+    const juce::String status = juce::String (juce::roundToInt (governor.getLoad() * 100.0f)) + "% - "
+                                + LoadGovernor::getTierName (governor.getTier());
+    
+    magicState.getPropertyAsValue ("governor:status").setValue (status);
+}
+
+// =============== HIGH QUALITY OFFLINE RENDERING ====================
+void KarPlusPlus2AudioProcessor::setOversamplingOrder (int newOrder)
+{
+    newOrder = juce::jlimit (0, maxOversamplingOrder, newOrder);
+    
+    if (newOrder == oversamplingOrder || oversamplers[0] == nullptr)
+        return;
+    
+    // A new rate would detune the strings still ringing, so the switch waits until every voice is idle
+    for (int i = 0; i < synth.getNumVoices(); ++i)
+        if (synth.getVoice (i)->isVoiceActive())
+            return;
+    
+    oversamplingOrder = newOrder;
+    
+    // Retunes the voices directly - no buffers are resized. Synthesiser::setCurrentPlaybackSampleRate would
+    // also run allNotesOff, which drops the held sustain pedal.
+    const double rate = engineSampleRate * (1 << oversamplingOrder);
+    for (int i = 0; i < synth.getNumVoices(); ++i)
+        synth.getVoice (i)->setCurrentPlaybackSampleRate (rate);
+    
+    if (oversamplingOrder > 0)
+        oversamplers[oversamplingOrder - 1]->reset();
+    
+    updateLatency();
+}
+
+void KarPlusPlus2AudioProcessor::updateLatency()
+{
+    int latency = upsampler.getLatencyInSamples();
+    
+    if (oversamplingOrder > 0) // The oversampler reports its delay at the engine rate
+        latency += juce::roundToInt (oversamplers[oversamplingOrder - 1]->getLatencyInSamples() * internalFactor);
+    
+    setLatencySamples (latency);
+}
+
+void KarPlusPlus2AudioProcessor::renderOversampled (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    auto& oversampler = *oversamplers[oversamplingOrder - 1];
+    const int factor = 1 << oversamplingOrder;
+    
+    // ====== RUN THE VOICES IN THE OVERSAMPLED BLOCK =======
+    buffer.clear();
+    juce::dsp::AudioBlock<float> hostBlock (buffer);
+    auto oversampledBlock = oversampler.processSamplesUp (hostBlock);
+    oversampledBlock.clear();
+    
+    float* channels[2] = { nullptr, nullptr };
+    const int numChannels = juce::jmin (2, (int) oversampledBlock.getNumChannels());
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+        channels[ch] = oversampledBlock.getChannelPointer ((size_t) ch);
+    
+    juce::AudioBuffer<float> oversampledBuffer (channels, numChannels, (int) oversampledBlock.getNumSamples()); // Refers to the oversampler's memory
+    
+    oversampledMidi.clear();
+    for (const auto metadata : midiMessages)
+        oversampledMidi.addEvent (metadata.getMessage(), metadata.samplePosition * factor);
+    
+    synth.renderNextBlock (oversampledBuffer, oversampledMidi, 0, oversampledBuffer.getNumSamples());
+    
+    // ====== POLYPHASE HALF-BAND DECIMATION BACK TO THE HOST RATE =======
+    oversampler.processSamplesDown (hostBlock);
 }
 
 //==============================================================================
@@ -268,8 +788,53 @@ juce::AudioProcessorValueTreeState::ParameterLayout KarPlusPlus2AudioProcessor::
     params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"LOPASS", 1}, "Lo Pass", 0.0f, 1.0f, 0.5f));
     
     // STRING
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "ENGINE", 1}, "String Engine", juce::StringArray { "Karplus Strong", "Waveguide", "Modal"}, 0));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"PLUCKPOS", 1}, "Pluck Position", 0.02f, 0.5f, 0.13f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"PICKUPPOS", 1}, "Pickup Position", 0.02f, 0.5f, 0.25f));
     params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"DAMPSTRING", 1}, "Dampen String", 0.0f, 1.0f, 0.5f));
     params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"FEEDBACK", 1}, "Feedback", 0.0f, 1.0f, 0.9f));
+    
+    // SATURATION
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "SATURATION", 1}, "Saturation", juce::StringArray { "Clip", "Fold", "Tanh"}, 0));
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "ANTIALIAS", 1}, "Anti-Aliasing", juce::StringArray { "Off", "ADAA 1st Order", "ADAA 2nd Order"}, 0));
+    
+    // UNISON
+    params.push_back(std::make_unique<juce::AudioParameterInt>(juce::ParameterID {"UNISON", 1}, "Unison", 1, UnisonString::maxStrings, 1));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"UNISONDETUNE", 1}, "Unison Detune", 0.0f, 50.0f, 12.0f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"UNISONSPREAD", 1}, "Unison Spread", 0.0f, 1.0f, 0.7f));
+    
+    // PITCH MODULATION
+    params.push_back(std::make_unique<juce::AudioParameterInt>(juce::ParameterID {"BENDRANGE", 1}, "Bend Range", 1, 24, 2));
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "PITCHINTERP", 1}, "Bend Interpolation", juce::StringArray { "Linear", "Lagrange", "Allpass"}, 1));
+    
+    // MPE
+    params.push_back (std::make_unique<juce::AudioParameterBool>(juce::ParameterID { "MPE", 1}, "MPE", false));
+    params.push_back(std::make_unique<juce::AudioParameterInt>(juce::ParameterID {"MPEBENDRANGE", 1}, "MPE Bend Range", 1, 96, 48));
+    
+    // SYMPATHETIC STRINGS
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"SYMPMIX", 1}, "Sympathetic Mix", 0.0f, 1.0f, 0.0f));
+    params.push_back(std::make_unique<juce::AudioParameterInt>(juce::ParameterID {"SYMPSTRINGS", 1}, "Sympathetic Strings", SympatheticBank::minStrings, SympatheticBank::maxStrings, 24));
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "SYMPSCALE", 1}, "Sympathetic Scale", juce::StringArray { "Chromatic", "Major", "Minor", "Pentatonic"}, 0));
+    params.push_back(std::make_unique<juce::AudioParameterInt>(juce::ParameterID {"SYMPROOT", 1}, "Sympathetic Root", 24, 60, 36));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"SYMPDECAY", 1}, "Sympathetic Decay", 0.5f, 10.0f, 3.0f));
+    
+    // BODY
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"BODYMIX", 1}, "Body Mix", 0.0f, 1.0f, 0.0f));
+    
+    // INTERNAL RATE
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "INTERNALRATE", 1}, "Internal Rate", juce::StringArray { "Host Rate", "48 kHz", "96 kHz"}, 0));
+    
+    // OFFLINE RENDERING
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "OFFLINEQUALITY", 1}, "Offline Quality", juce::StringArray { "Realtime", "2x", "4x", "8x"}, 2));
+    
+    // SIDECHAIN EXCITATION
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "EXCITESOURCE", 1}, "Excitation", juce::StringArray { "Oscillator", "Input", "Oscillator + Input"}, 0));
+    params.push_back (std::make_unique<juce::AudioParameterBool>(juce::ParameterID { "INPUTTRIGGER", 1}, "Input Trigger", true));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID {"INPUTTHRESHOLD", 1}, "Input Threshold", -60.0f, 0.0f, -30.0f));
+    params.push_back(std::make_unique<juce::AudioParameterInt>(juce::ParameterID {"INPUTNOTE", 1}, "Input Note", 24, 96, 48));
+    
+    // DELAY LINES
+    params.push_back (std::make_unique<juce::AudioParameterChoice>(juce::ParameterID { "DELAYSTORAGE", 1}, "Delay Storage", juce::StringArray { "32-bit Float", "16-bit Int"}, 0));
 
     
     // OUTPUT VOLUME
@@ -12,11 +12,19 @@
 
 #include <JuceHeader.h>
 #include "MySynthesiser.h"
+#include "Data/BodyResonance.h"
+#include "Data/SympatheticBank.h"
+#include "Data/LoadGovernor.h"
+#include "Data/InputFollower.h"
+#include "Data/PolyphaseUpsampler.h"
+#include "MultisampleExporter.h"
+#include "TraceRecorder.h"
 
 //==============================================================================
 /**
 */
-class KarPlusPlus2AudioProcessor : public foleys::MagicProcessor
+class KarPlusPlus2AudioProcessor : public foleys::MagicProcessor,
+                                   private juce::Timer
 {
 public:
     //==============================================================================
@@ -34,7 +42,7 @@ public:
     void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
     //==============================================================================
-//    juce::AudioProcessorEditor* createEditor() override;
+    juce::AudioProcessorEditor* createEditor() override;
 //    bool hasEditor() const override;
 
     //==============================================================================
@@ -59,16 +67,85 @@ public:
     //==============================================================================
     juce::AudioProcessorValueTreeState apvts; // Needs to be public
     
+    // ====== BODY IMPULSE RESPONSE =======
+    void loadBodyImpulseResponse (const juce::File& file);
+    void postSetStateInformation() override;
+    
+    // ====== OFFLINE MULTISAMPLE EXPORT - RUNS IN THE BACKGROUND =======
+    void exportMultisamples (const juce::ValueTree& preset, MultisampleExporter::Options options);
+    
     
 private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParams();
+    
+    // ====== ENGINE - RUNS AT THE INTERNAL RATE =======
+    void renderEngine (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages, int governorTier);
+    static int getInternalRateFactor (double hostRate, int rateChoice);
+    
+    // ====== SIDECHAIN EXCITATION =======
+    const float* captureExcitationInput (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+    
+    // ====== HIGH QUALITY OFFLINE RENDERING =======
+    void setOversamplingOrder (int newOrder);
+    void updateLatency(); // Host-rate resampler plus the oversampler in use
+    
+    // ====== LOAD GOVERNOR =======
+    void applyGovernor();
+    static bool isReleased (const MySynthVoice& voice); // Key up and no sustain pedal
+    void timerCallback() override; // Shows the governor tier in the GUI
+    void renderOversampled (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
     juce::AudioProcessorValueTreeState::ParameterLayout addVelToParams();
     
-    foleys::MagicPlotSource* analyser = nullptr;
+    std::atomic<foleys::MagicPlotSource*> analyser { nullptr }; // Created with the first editor
+    bool guiLoaded = false;
     
-    juce::Synthesiser synth;
+    // ====== STARTUP BENCHMARK - WALL CLOCK OF EACH STAGE IN DEBUG OUTPUT, 0 UNTIL IT HAS RUN =======
+    struct StartupTimings
+    {
+        double constructionMs = 0.0;
+        double prepareMs = 0.0;
+        double editorMs = 0.0; // First editor only - includes parsing the GUI tree
+    } startupTimings;
+    
+    MySynthesiser synth;
     int voiceCount = 12;
     
+    SympatheticBank sympathetic; // Shared by all voices - driven by the summed output
+    // ====== OVERSAMPLED STRING LOOP - 2x, 4x AND 8x ARE ALL PREALLOCATED =======
+    static constexpr int maxOversamplingOrder = 3;
+    std::unique_ptr<juce::dsp::Oversampling<float>> oversamplers[maxOversamplingOrder];
+    juce::MidiBuffer oversampledMidi;
+    int oversamplingOrder = 0; // 0 = lean realtime path
+    double engineSampleRate = 44100.0; // Host rate divided by internalFactor
+    
+    // ====== INTERNAL RATE - ONE POLYPHASE RESAMPLER FOR THE SUMMED MIX =======
+    int internalFactor = 1;
+    PolyphaseUpsampler upsampler;
+    juce::AudioBuffer<float> internalBuffer;
+    juce::MidiBuffer internalMidi;
+    
+    LoadGovernor governor;
+    int lastEngineBlockSize = 0; // Notes younger than this started during the last rendered block
+    
+    // ====== SIDECHAIN EXCITATION =======
+    juce::AudioBuffer<float> excitationInput; // Mono, read in place by every voice
+    float lastInputSample = 0.0f; // Continues the upsampling across blocks
+    InputFollower follower;
+    
+    // ====== MPE - EXPRESSION EVENTS BECOME RAMPS BEFORE THE SYNTH SEES THE BLOCK =======
+    MidiExpression expression;
+    
+    BodyResonance body; // Shared by all voices - applied on the summed output
+    std::unique_ptr<juce::FileChooser> bodyFileChooser;
+    
+    MultisampleExporter exporter;
+    
+    juce::SharedResourcePointer<ExcitationCache> excitationCache; // One per process - keyed by patch and sample rate
+    ExcitationCache::Patch lastExcitationPatch;
+    
+    juce::SharedResourcePointer<TraceRecorder> tracer; // One per process - opt in via KARPLUSPLUS_TRACE or the GUI
+    std::unique_ptr<juce::FileChooser> exportFileChooser;
+    
 //    foleys::MagicProcessorState magicState { *this, apvts };
     
     //==============================================================================
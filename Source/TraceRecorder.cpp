@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    TraceRecorder.cpp
+    Opt-in timeline of DSP spans, written as Chrome / Perfetto trace events.
+
+  ==============================================================================
+*/
+
+#include "TraceRecorder.h"
+
+//==============================================================================
+TraceRecorder::TraceRecorder() : juce::Thread ("Trace Writer")
+{
+    current().store (this, std::memory_order_release);
+
+    const juce::String path = juce::SystemStats::getEnvironmentVariable ("KARPLUSPLUS_TRACE", {});
+
+    if (path.isNotEmpty())
+        start (juce::File (path));
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+    current().store (nullptr, std::memory_order_release);
+}
+
+// ====== START / STOP =======
+bool TraceRecorder::start (const juce::File& file)
+{
+    stop();
+
+    file.deleteFile();
+    stream = file.createOutputStream();
+
+    if (stream == nullptr)
+        return false;
+
+    if (ring == nullptr) // First recording - the ring stays until the recorder goes, late spans may still land in it
+    {
+        ring = std::make_unique<Slot[]> (capacity);
+
+        for (juce::uint32 i = 0; i < capacity; ++i)
+            ring[i].sequence.store (i, std::memory_order_relaxed); // Slot i is free for write number i
+    }
+
+    Event stale;
+    while (pop (stale)) {} // Spans that raced the last stop()
+
+    outputFile = file;
+    originTicks = juce::Time::getHighResolutionTicks();
+    isFirstEvent = true;
+    numDropped.store (0);
+
+    stream->writeText ("{\"traceEvents\":[\n", false, false, nullptr);
+
+    recording.store (true, std::memory_order_release);
+    startThread();
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    if (! recording.exchange (false))
+        return;
+
+    stopThread (2000);
+    flush(); // Whatever arrived after the last pass
+
+    stream->writeText ("\n],\"otherData\":{\"droppedSpans\":" + juce::String (numDropped.load()) + "}}\n", false, false, nullptr);
+    stream.reset();
+}
+
+// ====== RECORDING - BOUNDED MULTI-PRODUCER QUEUE =======
+void TraceRecorder::record (const char* name, juce::int64 startTicks, juce::int64 endTicks, int value) noexcept
+{
+    auto* recorder = current().load (std::memory_order_acquire);
+
+    if (recorder == nullptr || ! recorder->recording.load (std::memory_order_acquire)) // Acquire - the ring is published by start()
+        return;
+
+    const Event event { name, startTicks, endTicks, (juce::int64) (juce::pointer_sized_int) juce::Thread::getCurrentThreadId(), value };
+
+    if (! recorder->push (event))
+        recorder->numDropped.fetch_add (1, std::memory_order_relaxed);
+}
+
+bool TraceRecorder::push (const Event& event) noexcept
+{
+    juce::uint32 pos = writePos.load (std::memory_order_relaxed);
+
+    for (;;)
+    {
+        Slot& slot = ring[pos & (capacity - 1)];
+        const juce::uint32 sequence = slot.sequence.load (std::memory_order_acquire);
+        const auto difference = (juce::int32) (sequence - pos);
+
+        if (difference == 0) // Free - claim it
+        {
+            if (writePos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.event = event;
+                slot.sequence.store (pos + 1, std::memory_order_release); // Hand it to the writer
+                return true;
+            }
+        }
+        else if (difference < 0) // Writer has not caught up - ring is full
+        {
+            return false;
+        }
+        else
+        {
+            pos = writePos.load (std::memory_order_relaxed); // Another producer took it
+        }
+    }
+}
+
+bool TraceRecorder::pop (Event& event) noexcept
+{
+    Slot& slot = ring[readPos & (capacity - 1)];
+
+    if (slot.sequence.load (std::memory_order_acquire) != readPos + 1)
+        return false;
+
+    event = slot.event;
+    slot.sequence.store (readPos + capacity, std::memory_order_release); // Free for the next lap
+    ++readPos;
+    return true;
+}
+
+// ====== WRITER THREAD =======
+void TraceRecorder::run()
+{
+    while (! threadShouldExit())
+    {
+        flush();
+        wait (50);
+    }
+}
+
+void TraceRecorder::flush()
+{
+    if (stream == nullptr)
+        return;
+
+    Event event;
+
+    while (pop (event))
+    {
+        const double startMicros = juce::Time::highResolutionTicksToSeconds (event.startTicks - originTicks) * 1.0e6;
+        const double durationMicros = juce::Time::highResolutionTicksToSeconds (event.endTicks - event.startTicks) * 1.0e6;
+
+        juce::String line;
+        line << (isFirstEvent ? "" : ",\n")
+             << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1"
+             << ",\"tid\":" << event.threadId
+             << ",\"ts\":" << juce::String (startMicros, 3)
+             << ",\"dur\":" << juce::String (durationMicros, 3);
+
+        if (event.value >= 0)
+            line << ",\"args\":{\"value\":" << event.value << "}";
+
+        line << "}";
+
+        stream->writeText (line, false, false, nullptr);
+        isFirstEvent = false;
+    }
+
+    stream->flush();
+}
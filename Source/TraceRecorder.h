@@ -0,0 +1,118 @@
+/*
+  ==============================================================================
+
+    TraceRecorder.h
+    Opt-in timeline of DSP spans, written as Chrome / Perfetto trace events.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+//==============================================================================
+/**
+    Records timestamped spans from any thread into a lock-free ring, and
+    drains it from a background thread into a trace-event JSON file that chrome://tracing
+    and ui.perfetto.dev open directly.
+
+    Recording starts when the environment variable KARPLUSPLUS_TRACE names an output file,
+    or when start() is called. While it is off a span costs one atomic load, and the ring is
+    only allocated by the first recording. When the ring is full, spans are dropped and
+    counted instead of blocking the audio thread.
+
+    One instance is shared by every plugin instance in the process through
+    juce::SharedResourcePointer.
+*/
+class TraceRecorder : private juce::Thread
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder() override;
+
+    // ====== MESSAGE THREAD =======
+    bool start (const juce::File& outputFile); // Returns false if the file cannot be written
+    void stop();
+
+    bool isRecording() const { return recording.load (std::memory_order_relaxed); }
+    juce::File getOutputFile() const { return outputFile; }
+    int getNumDropped() const { return numDropped.load(); }
+
+    // ====== ANY THREAD - LOCK FREE, NEVER ALLOCATES =======
+    static bool isEnabled() noexcept
+    {
+        auto* recorder = current().load (std::memory_order_acquire);
+        return recorder != nullptr && recorder->isRecording();
+    }
+
+    // name must outlive the recording - use string literals
+    static void record (const char* name, juce::int64 startTicks, juce::int64 endTicks, int value) noexcept;
+
+private:
+    struct Event
+    {
+        const char* name;
+        juce::int64 startTicks;
+        juce::int64 endTicks;
+        juce::int64 threadId;
+        int value; // Note number or similar, -1 for none
+    };
+
+    struct Slot
+    {
+        std::atomic<juce::uint32> sequence { 0 };
+        Event event;
+    };
+
+    static std::atomic<TraceRecorder*>& current()
+    {
+        static std::atomic<TraceRecorder*> recorder { nullptr };
+        return recorder;
+    }
+
+    bool push (const Event& event) noexcept;
+    bool pop (Event& event) noexcept;
+
+    void run() override;
+    void flush();
+
+    static constexpr juce::uint32 capacity = 1 << 16; // Power of two
+    std::unique_ptr<Slot[]> ring; // Allocated by the first start(), about 3 MB
+    std::atomic<juce::uint32> writePos { 0 };
+    juce::uint32 readPos = 0; // Only the writer thread reads
+
+    std::atomic<bool> recording { false };
+    std::atomic<int> numDropped { 0 };
+
+    juce::File outputFile;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    juce::int64 originTicks = 0;
+    bool isFirstEvent = true;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+};
+
+//==============================================================================
+/** Records the lifetime of the enclosing scope as one span. */
+struct TraceScope
+{
+    explicit TraceScope (const char* spanName, int spanValue = -1) noexcept
+        : name (spanName), value (spanValue),
+          startTicks (TraceRecorder::isEnabled() ? juce::Time::getHighResolutionTicks() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (startTicks != 0)
+            TraceRecorder::record (name, startTicks, juce::Time::getHighResolutionTicks(), value);
+    }
+
+    const char* name;
+    int value;
+    juce::int64 startTicks;
+
+    JUCE_DECLARE_NON_COPYABLE (TraceScope)
+};
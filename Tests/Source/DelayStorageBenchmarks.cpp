@@ -0,0 +1,71 @@
+/*
+  ==============================================================================
+
+    DelayStorageBenchmarks.cpp
+    Noise floor of the int16 delay storage against the float path.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/Data/FeedbackDelay.h"
+
+class DelayStorageBenchmarks : public juce::UnitTest
+{
+public:
+    DelayStorageBenchmarks() : juce::UnitTest ("Int16 delay storage", "KarPlusPlus Benchmarks") {}
+
+    void runTest() override
+    {
+        for (float samplerate : { 48000.0f, 96000.0f })
+        {
+            beginTest ("Noise floor at " + juce::String (samplerate, 0) + " Hz");
+
+            for (float freq : { 55.0f, 110.0f, 220.0f, 440.0f, 880.0f })
+            {
+                const float floorDb = measureCompactNoiseFloor (samplerate, freq);
+                logMessage (juce::String (freq, 0) + " Hz pluck: " + juce::String (floorDb, 1) + " dBFS");
+                expectLessThan (floorDb, -60.0f, "The README quotes about -76 dBFS");
+            }
+        }
+    }
+
+private:
+    // Opens the protected loop state, so both lines start at full length and full feedback
+    struct Loop : public Delay
+    {
+        Loop (DelayStorage format, float samplerate, float delayInSamples)
+        {
+            setStorage (format);
+            setSamplerate (samplerate);
+            setSize (samplerate);
+            smoothDelaytime.setCurrentAndTargetValue (delayInSamples); // No glide up from 0
+            setDelayTimeInSamples (delayInSamples);
+            feedback = 0.99f;
+        }
+    };
+
+    // Runs the same plucked feedback loop through both formats and returns the RMS difference in dBFS
+    static float measureCompactNoiseFloor (float samplerate, float testFreq)
+    {
+        Loop reference (DelayStorage::float32, samplerate, samplerate / testFreq);
+        Loop compact (DelayStorage::int16, samplerate, samplerate / testFreq);
+
+        const int period = (int) (samplerate / testFreq);
+        const int numSamples = (int) samplerate; // One second
+        double errorSum = 0.0;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float excitation = i < period ? std::sin (juce::MathConstants<float>::twoPi * (float) i / (float) period) : 0.0f;
+            float excitationCopy = excitation;
+
+            const float diff = reference.process (excitation) - compact.process (excitationCopy);
+            errorSum += (double) diff * diff;
+        }
+
+        return juce::Decibels::gainToDecibels ((float) std::sqrt (errorSum / numSamples), -200.0f);
+    }
+};
+
+static DelayStorageBenchmarks delayStorageBenchmarks;
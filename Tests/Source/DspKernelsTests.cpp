@@ -0,0 +1,153 @@
+/*
+  ==============================================================================
+
+    DspKernelsTests.cpp
+    Every kernel variant the CPU can run, checked against the scalar code it replaces.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/Data/DspKernels.h"
+#include "../../Source/Data/Saturators.h"
+#include "../../Source/Data/FeedbackDelay.h"
+
+class DspKernelsTests : public juce::UnitTest
+{
+public:
+    DspKernelsTests() : juce::UnitTest ("DSP kernels", "KarPlusPlus") {}
+
+    void runTest() override
+    {
+        const auto& selected = DspKernels::get();
+
+        for (auto isa : { DspKernels::Isa::generic, DspKernels::Isa::sse2, DspKernels::Isa::avx2, DspKernels::Isa::avx512 })
+        {
+            if (! DspKernels::forceIsa (isa))
+                continue;
+
+            beginTest (juce::String ("White noise matches the scalar generator - ") + DspKernels::get().name);
+            expect (noiseMatchesScalar (DspKernels::get()));
+
+            beginTest (juce::String ("Int16 block writes match the per-sample conversion - ") + DspKernels::get().name);
+            expect (compactMatchesScalar (DspKernels::get()));
+
+            beginTest (juce::String ("Unison lanes saturate like Saturator - ") + DspKernels::get().name);
+            expectEquals (laneSaturationError (DspKernels::get()), 0.0f);
+        }
+
+        DspKernels::forceIsa (selected.isa);
+    }
+
+private:
+    // The vectorised noise must be the scalar LCG, sample for sample - lengths cover the 8-lane tail
+    static bool noiseMatchesScalar (const DspKernels& kernels)
+    {
+        float block[67];
+
+        for (int numSamples : { 1, 7, 8, 9, 64, 67 })
+        {
+            uint32_t state = 12345u, reference = 12345u;
+            kernels.whiteNoise (block, state, numSamples);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                reference = reference * 1664525u + 1013904223u; // DspKernels.cpp lcgMultiplier, lcgIncrement
+
+                if (block[i] != (float) (int32_t) reference * (1.0f / 2147483648.0f))
+                    return false;
+            }
+
+            if (state != reference)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Delay::writeBlock and Delay::process must store the same int16 taps - out of range input covers the clamp
+    static bool compactMatchesScalar (const DspKernels& kernels)
+    {
+        float input[67], dither[67];
+        int16_t block[67];
+        juce::Random random (7);
+
+        for (auto& x : input)
+            x = (random.nextFloat() * 2.0f - 1.0f) * 1.5f * Delay::compactRange;
+
+        uint32_t state = 22222u;
+        kernels.whiteNoise (dither, state, 67);
+        kernels.toCompact (block, input, dither, Delay::floatToCompact, 67);
+
+        for (int i = 0; i < 67; ++i)
+            if (block[i] != Delay::toCompact (input[i], 0.5f * dither[i])) // nextDither() is the noise halved
+                return false;
+
+        return true;
+    }
+
+    // With the allpass and lowpass open, every lane outputs the saturated tap of the sample before. Each lane
+    // gets its own input, so a lane reading another lane's ADAA history shows up as a difference.
+    static float laneSaturationError (const DspKernels& kernels)
+    {
+        float worst = 0.0f;
+
+        for (int shape = 0; shape < 3; ++shape)
+            for (int order = 0; order < 3; ++order)
+            {
+                StringLanes lanes;
+                lanes.coeffs[0] = 1.0f; // b0 only - the lowpass passes its input
+                lanes.shape = (SaturationShape) shape;
+                lanes.antialiasing = (Antialiasing) order;
+
+                Saturator reference[StringLanes::maxLanes];
+                juce::Random random (shape * 3 + order);
+
+                for (int s = 0; s < StringLanes::maxLanes; ++s)
+                {
+                    reference[s].setShape (lanes.shape);
+                    reference[s].setAntialiasing (lanes.antialiasing);
+                }
+
+                float expected[StringLanes::maxLanes] {};
+
+                for (int n = 0; n < 256; ++n)
+                {
+                    float inputs[StringLanes::maxLanes];
+
+                    for (int s = 0; s < StringLanes::maxLanes; ++s)
+                    {
+                        inputs[s] = (random.nextFloat() * 2.0f - 1.0f) * 4.0f;
+                        if (n % 5 == 0)
+                            inputs[s] = 0.25f; // Repeats take the ill-conditioned paths
+                        lanes.tap[s] = inputs[s];
+                    }
+
+                    for (int s = 0; s < StringLanes::maxLanes; ++s)
+                    {
+                        for (int other = 0; other < StringLanes::maxLanes; ++other)
+                        {
+                            lanes.panLeft[other] = other == s ? 1.0f : 0.0f;
+                            lanes.panRight[other] = 0.0f;
+                        }
+
+                        // One lane audible at a time - the state only moves on the last pass
+                        StringLanes probe = lanes;
+                        float left = 0.0f, right = 0.0f;
+                        kernels.stringLanes (probe, 0.0f, 0.0f, left, right);
+                        worst = juce::jmax (worst, std::abs (left - expected[s]));
+
+                        if (s == StringLanes::maxLanes - 1)
+                            lanes = probe;
+                    }
+
+                    for (int s = 0; s < StringLanes::maxLanes; ++s)
+                        expected[s] = reference[s].process (inputs[s]);
+                }
+            }
+
+        return worst;
+    }
+};
+
+static DspKernelsTests dspKernelsTests;
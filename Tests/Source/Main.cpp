@@ -0,0 +1,26 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Runs the KarPlusPlus unit tests, or the benchmarks with --benchmarks.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser; // Message manager for the tests that need one
+    juce::ArgumentList args (argc, argv);
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure (false);
+    runner.runTestsInCategory (args.containsOption ("--benchmarks") ? "KarPlusPlus Benchmarks" : "KarPlusPlus");
+
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        if (runner.getResult (i)->failures > 0)
+            return 1;
+
+    return 0;
+}
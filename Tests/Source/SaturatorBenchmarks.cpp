@@ -0,0 +1,137 @@
+/*
+  ==============================================================================
+
+    SaturatorBenchmarks.cpp
+    Aliasing and cost of the loop saturation: naive, ADAA and oversampled.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/Data/Saturators.h"
+
+class SaturatorBenchmarks : public juce::UnitTest
+{
+public:
+    SaturatorBenchmarks() : juce::UnitTest ("Saturation aliasing", "KarPlusPlus Benchmarks") {}
+
+    void runTest() override
+    {
+        const char* shapes[] = { "clip", "fold", "tanh" };
+        const char* names[] = { "naive", "ADAA 1st", "ADAA 2nd", "2x oversampled", "4x oversampled" };
+
+        for (int shape = 0; shape < 3; ++shape)
+        {
+            beginTest (juce::String ("Saturation ") + shapes[shape]);
+            const auto report = measure ((SaturationShape) shape);
+
+            for (int i = 0; i < 5; ++i)
+                logMessage (juce::String (names[i]) + ": aliasing " + juce::String (report.aliasDb[i], 1) + " dB, "
+                            + juce::String (report.nsPerSample[i], 1) + " ns/sample");
+
+            expectLessThan (report.aliasDb[1], report.aliasDb[0], "ADAA should alias less than the naive shape");
+        }
+    }
+
+private:
+    // ====== ALIASING AND COST AGAINST THE NAIVE SHAPE, ADAA AND OVERSAMPLING =======
+    // Drives a bin-centred sine far into the nonlinearity. The output is periodic in the analysis length, so
+    // every bin that is not a harmonic below Nyquist holds aliasing only.
+    struct Report
+    {
+        float aliasDb[5]; // Naive, ADAA 1st, ADAA 2nd, naive at 2x, naive at 4x - relative to the harmonics
+        float nsPerSample[5];
+    };
+
+    static Report measure (SaturationShape s, float drive = 4.0f)
+    {
+        constexpr int length = 8192;
+        constexpr int bin = 1031; // Prime - aliases never land on a harmonic
+        constexpr int warmUp = 64;
+
+        Report report {};
+        juce::AudioBuffer<float> signal (1, length);
+
+        for (int variant = 0; variant < 5; ++variant)
+        {
+            auto* data = signal.getWritePointer (0);
+            const int oversamplingOrder = variant >= 3 ? variant - 2 : 0;
+            const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+
+            if (oversamplingOrder == 0)
+            {
+                Saturator saturator;
+                saturator.setShape (s);
+                saturator.setAntialiasing ((Antialiasing) variant);
+
+                for (int i = 0; i < length; ++i)
+                    data[i] = drive * (float) std::sin (juce::MathConstants<double>::twoPi * bin * (double) i / length);
+
+                for (int i = length - warmUp; i < length; ++i) // Settles the ADAA history on the end of the period
+                    saturator.process (data[i]);
+
+                saturator.processBlock (data, length); // DspKernels::saturate
+            }
+            else
+            {
+                // The same polyphase IIR oversampler the offline renders use
+                juce::dsp::Oversampling<float> oversampler (1, (size_t) oversamplingOrder, juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, true);
+                oversampler.initProcessing ((size_t) length);
+
+                for (int pass = 0; pass < 2; ++pass) // First pass settles the filters on the periodic input
+                {
+                    for (int i = 0; i < length; ++i)
+                        data[i] = drive * (float) std::sin (juce::MathConstants<double>::twoPi * bin * (double) i / length);
+
+                    juce::dsp::AudioBlock<float> block (signal);
+                    auto upsampled = oversampler.processSamplesUp (block);
+                    float* up = upsampled.getChannelPointer (0);
+
+                    for (size_t i = 0; i < upsampled.getNumSamples(); ++i)
+                        up[i] = (float) Saturator::apply (s, up[i]);
+
+                    oversampler.processSamplesDown (block);
+                }
+            }
+
+            const double seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+            report.nsPerSample[variant] = (float) (seconds * 1.0e9 / (oversamplingOrder == 0 ? length + warmUp : 2 * length));
+
+            // Parseval: everything that is not DC or a harmonic below Nyquist is aliasing
+            double total = 0.0, mean = 0.0;
+            for (int i = 0; i < length; ++i)
+            {
+                total += (double) data[i] * data[i];
+                mean += data[i];
+            }
+
+            mean /= length;
+            double harmonics = 0.0;
+            for (int k = 1; k * bin < length / 2; ++k)
+                harmonics += binPower (data, length, k * bin);
+
+            const double aliasing = juce::jmax (1.0e-20, total / length - mean * mean - harmonics);
+            report.aliasDb[variant] = (float) (10.0 * std::log10 (aliasing / juce::jmax (1.0e-20, harmonics)));
+        }
+
+        return report;
+    }
+
+    static double binPower (const float* data, int length, int bin) // Goertzel - power of one sinusoid
+    {
+        const double coeff = 2.0 * std::cos (juce::MathConstants<double>::twoPi * bin / length);
+        double s1 = 0.0, s2 = 0.0;
+
+        for (int i = 0; i < length; ++i)
+        {
+            const double s0 = data[i] + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+
+        const double magnitudeSquared = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        return 2.0 * magnitudeSquared / ((double) length * length); // Mean power of the sinusoid
+    }
+};
+
+static SaturatorBenchmarks saturatorBenchmarks;
@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    StringModelTests.cpp
+    KarplusStrong::processBlock() against the per-sample process() it replaces.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/Data/StringModel.h"
+
+class StringModelTests : public juce::UnitTest
+{
+public:
+    StringModelTests() : juce::UnitTest ("Karplus Strong", "KarPlusPlus") {}
+
+    void runTest() override
+    {
+        for (float samplerate : { 44100.0f, 96000.0f })
+        {
+            beginTest ("processBlock() matches process() at " + juce::String (samplerate, 0) + " Hz");
+            expectEquals (measureBlockError (samplerate), 0.0f, "The spans must not change the sound");
+        }
+    }
+
+private:
+    // Plucks two identical strings per shape and pitch, one sample by sample and one in uneven blocks
+    // that straddle the span boundaries, and returns the largest difference between the two outputs.
+    static float measureBlockError (float samplerate)
+    {
+        float worst = 0.0f;
+
+        for (int shape = 0; shape < 3; ++shape)
+            for (float freq : { 55.0f, 440.0f, 3000.0f, 12000.0f }) // 12 kHz takes the scalar fallback
+            {
+                KarplusStrong scalar, blocked;
+
+                for (KarplusStrong* k : { &scalar, &blocked })
+                {
+                    k->setSamplerate (samplerate);
+                    k->setSize (samplerate);
+                    k->setRandomSeed (1);
+                    k->setSaturation ((SaturationShape) shape, Antialiasing::secondOrder);
+                    k->setDampening (0.6f);
+                    k->setFeedback (0.99f);
+                    k->setPitch (freq);
+                }
+
+                const int numSamples = (int) samplerate / 4;
+                juce::HeapBlock<float> input (numSamples), expected (numSamples), actual (numSamples);
+                juce::Random noise (1);
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    input[i] = i < 256 ? noise.nextFloat() * 2.0f - 1.0f : 0.0f;
+                    float inSamp = input[i];
+                    expected[i] = scalar.process (inSamp);
+                }
+
+                const int blockSizes[] = { 1, 17, 64, 333, 512 };
+
+                for (int pos = 0, b = 0; pos < numSamples; ++b)
+                {
+                    const int n = juce::jmin (numSamples - pos, blockSizes[b % 5]);
+                    blocked.processBlock (input + pos, actual + pos, n);
+                    pos += n;
+                }
+
+                for (int i = 0; i < numSamples; ++i)
+                    worst = juce::jmax (worst, std::abs (expected[i] - actual[i]));
+            }
+
+        return worst;
+    }
+};
+
+static StringModelTests stringModelTests;
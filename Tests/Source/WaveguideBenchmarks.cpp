@@ -0,0 +1,133 @@
+/*
+  ==============================================================================
+
+    WaveguideBenchmarks.cpp
+    Cost and tuning of the two-rail waveguide against the Karplus Strong loop.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/Data/StringModel.h"
+#include "../../Source/Data/WaveguideString.h"
+
+class WaveguideBenchmarks : public juce::UnitTest
+{
+public:
+    WaveguideBenchmarks() : juce::UnitTest ("Waveguide string", "KarPlusPlus Benchmarks") {}
+
+    void runTest() override
+    {
+        constexpr float samplerate = 48000.0f;
+        juce::ScopedNoDenormals noDenormals; // As in the plugin's processBlock()
+
+        for (float freq : { 110.0f, 440.0f, 1760.0f, 3520.0f })
+        {
+            beginTest (juce::String (freq, 0) + " Hz");
+
+            KarplusStrong karplusStrong;
+            prepare (karplusStrong, samplerate, freq);
+            const float karplusNs = measureNs (karplusStrong, [] (int) {});
+
+            WaveguideString waveguide;
+            prepare (waveguide, samplerate, freq);
+            const float waveguideNs = measureNs (waveguide, [] (int) {});
+
+            // Vibrato of +-50 cents, retuned every 32 samples like a voice chunk
+            WaveguideString gliding;
+            prepare (gliding, samplerate, freq);
+            const float glidingNs = measureNs (gliding, [&] (int i)
+            {
+                if (i % 32 == 0)
+                    gliding.glideTo (freq * std::exp2 (0.5f * std::sin ((float) i * 0.001f) / 12.0f), 32);
+            });
+
+            logMessage ("KarplusStrong::process " + juce::String (karplusNs, 1) + " ns/sample, WaveguideString::process "
+                        + juce::String (waveguideNs, 1) + " ns/sample (" + juce::String (waveguideNs / karplusNs, 2) + "x), gliding "
+                        + juce::String (glidingNs, 1) + " ns/sample");
+
+            WaveguideString tuned;
+            prepare (tuned, samplerate, freq);
+            const float cents = measureTuningCents (tuned, samplerate, freq);
+            logMessage ("Waveguide tuning " + juce::String (cents, 2) + " cents");
+            if (freq <= 1760.0f) // A 14 sample period is too coarse for the parabola
+                expectLessThan (std::abs (cents), 1.0f, "Thiran and loop filter delay should keep the string in tune");
+        }
+    }
+
+private:
+    template <typename String>
+    static void prepare (String& string, float samplerate, float freq)
+    {
+        string.setSamplerate (samplerate);
+        string.setSize (samplerate);
+        string.setDampening (0.6f);
+        string.setFeedback (0.999f);
+        string.setPitch (freq);
+    }
+
+    // Best of five runs of one second, plucked with noise - the minimum is the least disturbed by the OS
+    template <typename String, typename Modulation>
+    static float measureNs (String& string, Modulation&& modulate)
+    {
+        constexpr int numSamples = 48000;
+        juce::Random noise (1);
+        double best = 1.0e9;
+        float sink = 0.0f;
+
+        for (int run = 0; run < 5; ++run)
+        {
+            const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                modulate (i);
+                float inSamp = i < 256 ? noise.nextFloat() * 2.0f - 1.0f : 0.0f;
+                sink += string.process (inSamp);
+            }
+
+            best = juce::jmin (best, juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks));
+        }
+
+        juce::ignoreUnused (sink);
+        return (float) (best * 1.0e9 / numSamples);
+    }
+
+    // Period from the autocorrelation peak near the expected lag, refined with a parabola through its neighbours
+    static float measureTuningCents (WaveguideString& string, float samplerate, float freq)
+    {
+        const int numSamples = (int) samplerate / 2;
+        const int start = numSamples / 4; // Past the attack
+        const int window = 4096;
+        juce::HeapBlock<float> output (numSamples);
+        juce::Random noise (1);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float inSamp = i < 256 ? noise.nextFloat() * 2.0f - 1.0f : 0.0f;
+            output[i] = string.process (inSamp);
+        }
+
+        auto correlation = [&] (int lag)
+        {
+            double sum = 0.0;
+            for (int i = start; i < start + window; ++i)
+                sum += (double) output[i] * output[i + lag];
+            return sum;
+        };
+
+        const int expected = (int) std::round (samplerate / freq);
+        int bestLag = expected;
+
+        for (int lag = expected - 2; lag <= expected + 2; ++lag)
+            if (correlation (lag) > correlation (bestLag))
+                bestLag = lag;
+
+        const double below = correlation (bestLag - 1), peak = correlation (bestLag), above = correlation (bestLag + 1);
+        const double period = bestLag + 0.5 * (below - above) / (below - 2.0 * peak + above);
+
+        return (float) (1200.0 * std::log2 (samplerate / period / freq));
+    }
+};
+
+static WaveguideBenchmarks waveguideBenchmarks;